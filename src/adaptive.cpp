@@ -0,0 +1,134 @@
+#include "ratings.h"
+#include "step_sizes.h"
+#include "timer.h"
+
+#include <cmath>
+
+// The kstep update with K chosen each iteration instead of scheduled. The
+// step direction is the error per game, as for kstep. Along it the errors
+// are close to linear in K, e(K) = e0 + K g, so after trying one K the
+// secant g = (e(K) - e0) / K gives the K that minimises the squared error.
+// That is used for the next iteration, where the direction is much the
+// same. A trial that doesn't reduce the total error is rejected and tried
+// again with a smaller K, so the total error never goes up.
+
+namespace
+{
+
+constexpr double min_k = 1e-3;
+constexpr double max_k = 100;
+
+constexpr int max_trials = 30;
+
+struct SecantSums
+{
+  // e0 . (e1 - e0) and |e1 - e0|^2
+  double cross = 0;
+  double change = 0;
+
+  SecantSums& operator+=(const SecantSums& other)
+  {
+    cross += other.cross;
+    change += other.change;
+    return *this;
+  }
+};
+
+}
+
+int RatingsCalc::solve_adaptive()
+{
+  Timer timer;
+  stalled_ = false;
+  auto n = ratings_.size();
+  std::vector<double> start_ratings(n);
+  std::vector<double> start_errors(n);
+
+  double K = kstep_k;
+  double e = calculate_errors();
+  ErrorNorms start_norms;
+  int passes = 1;
+  int rejected = 0;
+
+  // the same update as kstep, from the ratings and errors at the start of
+  // the iteration
+  auto graph = kernel_graph();
+  auto adjust = log_domain_ ? kernels_->adjust_log : kernels_->adjust;
+
+  int i;
+  for (i = 0; !out_of_budget(i); ++i)
+  {
+    timer.start();
+    if (i % 100 == 0)
+    {
+      std::cout << "Total error = " << e << ", K = " << K << std::endl;
+    }
+
+    if (converged())
+    {
+      break;
+    }
+
+    start_ratings = ratings_;
+    start_errors = errors_;
+    start_norms = error_norms_;
+
+    bool accepted = false;
+    for (int trial = 0; trial != max_trials && !accepted; ++trial)
+    {
+      parallel_ranges(pool(), work_ranges_, [&](size_t begin, size_t end) {
+        std::copy(start_ratings.begin() + begin, start_ratings.begin() + end, ratings_.begin() + begin);
+        adjust(graph, ratings_.data(), start_errors.data(), K, begin, end);
+      });
+
+      double trial_error = calculate_errors();
+      ++passes;
+
+      auto sums = parallel_sum(pool(), work_ranges_, [&](size_t begin, size_t end) {
+        SecantSums sums;
+        for (size_t p = begin; p != end; ++p)
+        {
+          auto change = errors_[p] - start_errors[p];
+          sums.cross += start_errors[p] * change;
+          sums.change += change * change;
+        }
+        return sums;
+      });
+
+      double secant = sums.change > 0 ? -K * sums.cross / sums.change : K;
+
+      if (trial_error < e)
+      {
+        accepted = true;
+        e = trial_error;
+        // grow at most twofold, since the secant is least reliable when
+        // it asks for a big jump
+        K = std::clamp(secant, min_k, std::min(2 * K, max_k));
+      }
+      else
+      {
+        ++rejected;
+        K = std::max(secant < K ? secant : K / 2, min_k);
+      }
+    }
+
+    if (!accepted)
+    {
+      // no K reduces the error any more, which is as close as this gets
+      ratings_ = start_ratings;
+      errors_ = start_errors;
+      error_norms_ = start_norms;
+      stalled_ = true;
+      break;
+    }
+
+    if (i % 50 == 0)
+    {
+      timer.stop("adaptive step");
+    }
+  }
+
+  std::cout << passes << " error passes, " << rejected << " rejected steps" << std::endl;
+
+  return i;
+}
@@ -0,0 +1,266 @@
+#include "ratings.h"
+#include "step_sizes.h"
+#include "timer.h"
+
+#include <cmath>
+
+// Anderson acceleration of the fixed point iteration. The plain kstep or
+// mm update is the map G, applied to the log ratings x. Each iteration takes
+// the combination of the last m updates that best cancels the residual
+// f = G(x) - x, found by least squares on the differences between
+// successive residuals.
+
+namespace
+{
+
+// The Gram matrix of the residual differences, and their dot products with
+// the current residual, packed as m rows of m + 1.
+struct GramSums
+{
+  std::vector<double> sums;
+
+  GramSums& operator+=(const GramSums& other)
+  {
+    sums.resize(other.sums.size());
+    for (size_t i = 0; i != sums.size(); ++i)
+    {
+      sums[i] += other.sums[i];
+    }
+    return *this;
+  }
+};
+
+// Solves the m by m system in the first m columns of a, with the right hand
+// side in column m, by Gaussian elimination with partial pivoting.
+std::vector<double> solve_small(std::vector<double> a, int m)
+{
+  auto at = [&a, m](int r, int c) -> double& {
+    return a[r * (m + 1) + c];
+  };
+
+  for (int c = 0; c != m; ++c)
+  {
+    int pivot = c;
+    for (int r = c + 1; r != m; ++r)
+    {
+      if (std::fabs(at(r, c)) > std::fabs(at(pivot, c)))
+      {
+        pivot = r;
+      }
+    }
+
+    for (int k = 0; k != m + 1; ++k)
+    {
+      std::swap(at(c, k), at(pivot, k));
+    }
+
+    for (int r = c + 1; r != m; ++r)
+    {
+      double factor = at(c, c) != 0 ? at(r, c) / at(c, c) : 0;
+      for (int k = c; k != m + 1; ++k)
+      {
+        at(r, k) -= factor * at(c, k);
+      }
+    }
+  }
+
+  std::vector<double> x(m);
+  for (int r = m - 1; r >= 0; --r)
+  {
+    double sum = at(r, m);
+    for (int k = r + 1; k != m; ++k)
+    {
+      sum -= at(r, k) * x[k];
+    }
+    x[r] = at(r, r) != 0 ? sum / at(r, r) : 0;
+  }
+
+  return x;
+}
+
+}
+
+int RatingsCalc::solve_anderson()
+{
+  Timer timer;
+  auto n = ratings_.size();
+  int m = options_.anderson;
+
+  std::vector<double> x(n);
+  std::vector<double> g(n);
+  std::vector<double> f(n);
+  std::vector<double> previous_g(n);
+  std::vector<double> previous_f(n);
+  std::vector<std::vector<double>> delta_f(m, std::vector<double>(n));
+  std::vector<std::vector<double>> delta_g(m, std::vector<double>(n));
+  int history = 0;
+  int oldest = 0;
+  int fallbacks = 0;
+
+  parallel_ranges(pool(), work_ranges_, [&](size_t begin, size_t end) {
+    for (size_t p = begin; p != end; ++p)
+    {
+      x[p] = std::log(ratings_[p]);
+    }
+  });
+
+  // a fixed K, since the periodic large K of the schedule is a crude
+  // extrapolation of its own, and changes the map under the history
+  adjust_state_.K = kstep_k;
+  double previous_error = std::numeric_limits<double>::infinity();
+  bool accelerated = false;
+
+  int i;
+  for (i = 0; !out_of_budget(i); ++i)
+  {
+    timer.start();
+    double e = calculate_errors();
+
+    // safeguard: if the extrapolated point made things worse, go back to
+    // the plain step from the last point and start the history again
+    if (accelerated && e > previous_error)
+    {
+      ++fallbacks;
+      history = 0;
+      parallel_ranges(pool(), work_ranges_, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p != end; ++p)
+        {
+          x[p] = previous_g[p];
+          ratings_[p] = std::exp(x[p]);
+        }
+      });
+      e = calculate_errors();
+    }
+
+    if (i % 50 == 0)
+    {
+      timer.stop("calculate_errors");
+    }
+    if (i % 100 == 0)
+    {
+      std::cout << "Total error = " << e << std::endl;
+    }
+
+    if (converged())
+    {
+      break;
+    }
+
+    previous_error = e;
+
+    // the plain update, which leaves G(x) in ratings_
+    adjust_waiter_.run_and_wait(pool());
+
+    int slot = (oldest + history) % m;
+    bool record = i != 0;
+    parallel_ranges(pool(), work_ranges_, [&](size_t begin, size_t end) {
+      for (size_t p = begin; p != end; ++p)
+      {
+        // capped so the residual stays finite for players the plain update
+        // sends to zero
+        double step = ratings_[p] > 0 ? std::log(ratings_[p]) - x[p] : -max_log_step;
+        f[p] = std::clamp(step, -max_log_step, max_log_step);
+        g[p] = x[p] + f[p];
+
+        if (record)
+        {
+          delta_f[slot][p] = f[p] - previous_f[p];
+          delta_g[slot][p] = g[p] - previous_g[p];
+        }
+
+        previous_f[p] = f[p];
+        previous_g[p] = g[p];
+      }
+    });
+
+    if (record)
+    {
+      if (history == m)
+      {
+        oldest = (oldest + 1) % m;
+      }
+      else
+      {
+        ++history;
+      }
+    }
+
+    accelerated = history != 0;
+    if (!accelerated)
+    {
+      parallel_ranges(pool(), work_ranges_, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p != end; ++p)
+        {
+          x[p] = g[p];
+          ratings_[p] = std::exp(x[p]);
+        }
+      });
+      continue;
+    }
+
+    // least squares for the weights: (dF' dF) gamma = dF' f
+    auto slots = [&](int k) { return (oldest + k) % m; };
+    auto gram = parallel_sum(pool(), work_ranges_, [&](size_t begin, size_t end) {
+      GramSums partial;
+      partial.sums.resize(history * (history + 1));
+      for (int r = 0; r != history; ++r)
+      {
+        auto& dr = delta_f[slots(r)];
+        for (int c = r; c != history; ++c)
+        {
+          auto& dc = delta_f[slots(c)];
+          double sum = 0;
+          for (size_t p = begin; p != end; ++p)
+          {
+            sum += dr[p] * dc[p];
+          }
+          partial.sums[r * (history + 1) + c] = sum;
+        }
+
+        double sum = 0;
+        for (size_t p = begin; p != end; ++p)
+        {
+          sum += dr[p] * f[p];
+        }
+        partial.sums[r * (history + 1) + history] = sum;
+      }
+      return partial;
+    });
+
+    auto& a = gram.sums;
+    double trace = 0;
+    for (int r = 0; r != history; ++r)
+    {
+      for (int c = 0; c != r; ++c)
+      {
+        a[r * (history + 1) + c] = a[c * (history + 1) + r];
+      }
+      trace += a[r * (history + 1) + r];
+    }
+
+    // a little regularisation for when the differences are nearly parallel
+    for (int r = 0; r != history; ++r)
+    {
+      a[r * (history + 1) + r] += 1e-10 * trace / history;
+    }
+
+    auto gamma = solve_small(a, history);
+
+    parallel_ranges(pool(), work_ranges_, [&](size_t begin, size_t end) {
+      for (size_t p = begin; p != end; ++p)
+      {
+        double next = g[p];
+        for (int k = 0; k != history; ++k)
+        {
+          next -= gamma[k] * delta_g[slots(k)][p];
+        }
+        x[p] = next;
+        ratings_[p] = std::exp(x[p]);
+      }
+    });
+  }
+
+  std::cout << fallbacks << " Anderson fallbacks to the plain step" << std::endl;
+
+  return i;
+}
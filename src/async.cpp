@@ -0,0 +1,133 @@
+#include "ratings.h"
+#include "step_sizes.h"
+#include "timer.h"
+
+#include <atomic>
+#include <cmath>
+
+// Asynchronous Gauss-Seidel. Each thread owns a block of players and sweeps
+// it over and over, updating each rating as soon as its error is known, so
+// later players in the sweep already see the new ratings. Opponents owned
+// by other threads are read without synchronisation, and may be a sweep
+// old, which the iteration tolerates. Only the stores are atomic, so that a
+// reader never sees half a rating; atomic loads on the gather cost nearly
+// twice the time per sweep. There is no barrier between sweeps: each
+// thread publishes the error norms of its last sweep, and stops once the
+// published norms together meet the convergence policy.
+
+namespace
+{
+
+// how many sweeps a thread makes between looks at the other threads
+constexpr int check_interval = 4;
+
+}
+
+int RatingsCalc::solve_async()
+{
+  Timer timer;
+  timer.start();
+
+  // one block per thread, balanced by games, since every block runs for the
+  // whole solve and a queued block would never start
+  size_t threads = pool() ? pool()->pool_size() : 1;
+  auto players = ratings_.size();
+  auto games = game_indexes_.back();
+  JobRanges blocks;
+  size_t begin = 0;
+  for (size_t t = 1; t <= threads; ++t)
+  {
+    size_t end = t == threads ? players : std::lower_bound(game_indexes_.begin() + begin,
+      game_indexes_.end() - 1, static_cast<double>(games) * t / threads) - game_indexes_.begin();
+    blocks.emplace_back(begin, end);
+    begin = end;
+  }
+
+  constexpr auto unknown = std::numeric_limits<double>::infinity();
+  std::vector<ErrorNorms> residuals(blocks.size(), {unknown, unknown});
+  std::vector<int> sweeps(blocks.size());
+  std::atomic<bool> done = false;
+  int total_sweeps = 0;
+
+  auto sweep = [&](size_t block) {
+    auto [begin, end] = blocks[block];
+    auto graph = kernel_graph();
+    ErrorNorms norms;
+    for (size_t p = begin; p != end; ++p)
+    {
+      norms += player_error_kernel_(graph, errors_.data(), p, p + 1);
+      if (played_[p] == 0)
+      {
+        continue;
+      }
+
+      auto rating = updated_rating(p, ratings_[p], errors_[p], kstep_k);
+      std::atomic_ref(ratings_[p]).store(rating, std::memory_order_relaxed);
+    }
+
+    return norms;
+  };
+
+  auto worker = [&](size_t block) {
+    int s;
+    for (s = 0; !done.load(std::memory_order_relaxed); ++s)
+    {
+      auto norms = sweep(block);
+      std::atomic_ref(residuals[block].total).store(norms.total, std::memory_order_relaxed);
+      std::atomic_ref(residuals[block].max_per_player).store(norms.max_per_player,
+        std::memory_order_relaxed);
+
+      if (s % check_interval == 0)
+      {
+        ErrorNorms published;
+        for (auto& residual : residuals)
+        {
+          published += {std::atomic_ref(residual.total).load(std::memory_order_relaxed),
+            std::atomic_ref(residual.max_per_player).load(std::memory_order_relaxed)};
+        }
+
+        if (converged(published) || out_of_budget(total_sweeps + s))
+        {
+          done.store(true, std::memory_order_relaxed);
+        }
+      }
+    }
+    sweeps[block] = s;
+  };
+
+  std::vector<ThreadPool::ThreadJob> jobs;
+  for (size_t block = 0; block != blocks.size(); ++block)
+  {
+    jobs.push_back([&worker, block]() {
+      worker(block);
+    });
+  }
+
+  ThreadPoolWaiter waiter;
+  waiter.set_jobs(jobs);
+
+  // The published totals were measured against ratings that kept moving, so
+  // confirm with a full error pass, and carry on if it isn't there yet.
+  int rounds = 0;
+  for (; !out_of_budget(total_sweeps); ++rounds)
+  {
+    done = false;
+    std::fill(residuals.begin(), residuals.end(), ErrorNorms{unknown, unknown});
+    waiter.run_and_wait(pool());
+    total_sweeps += *std::max_element(sweeps.begin(), sweeps.end());
+
+    double e = calculate_errors();
+    std::cout << "Total error = " << e << " after " << total_sweeps << " sweeps" << std::endl;
+    if (converged())
+    {
+      break;
+    }
+  }
+
+  auto [fewest, most] = std::minmax_element(sweeps.begin(), sweeps.end());
+  std::cout << "Sweeps per thread in the last round: " << *fewest << "--" << *most
+    << ", " << rounds + 1 << " rounds" << std::endl;
+  timer.stop("async sweeps");
+
+  return total_sweeps;
+}
@@ -0,0 +1,112 @@
+#include "binary_games.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace
+{
+
+// The first byte isn't ASCII, and can't start a UTF-8 character, so no
+// text games file begins with the magic, as in PNG.
+constexpr char magic[4] = {'\x89', 'R', 'T', 'G'};
+constexpr uint32_t version = 1;
+
+size_t padding(size_t bytes)
+{
+  return (8 - bytes % 8) % 8;
+}
+
+}
+
+bool is_binary_games(const char* memory, size_t length)
+{
+  return length >= sizeof(magic) && std::memcmp(memory, magic, sizeof(magic)) == 0;
+}
+
+void write_binary_games(const char* file, const std::vector<std::string_view>& names,
+  const std::vector<BinaryGame>& games)
+{
+  std::ofstream out(file, std::ios::binary);
+  if (!out)
+  {
+    throw std::string("Unable to open ") + file + " for writing";
+  }
+
+  std::vector<uint64_t> offsets;
+  offsets.reserve(names.size() + 1);
+  uint64_t name_bytes = 0;
+  offsets.push_back(0);
+  for (auto name : names)
+  {
+    name_bytes += name.size();
+    offsets.push_back(name_bytes);
+  }
+
+  BinaryGamesHeader header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.players = names.size();
+  header.name_bytes = name_bytes;
+  header.games = games.size();
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+  for (auto name : names)
+  {
+    out.write(name.data(), name.size());
+  }
+
+  const char zeros[8]{};
+  out.write(zeros, padding(name_bytes));
+  out.write(reinterpret_cast<const char*>(games.data()), games.size() * sizeof(BinaryGame));
+
+  if (!out)
+  {
+    throw std::string("Error writing ") + file;
+  }
+}
+
+BinaryGamesView::BinaryGamesView(const char* memory, size_t length)
+{
+  BinaryGamesHeader header;
+  if (length < sizeof(header))
+  {
+    throw std::string("Binary games file is truncated");
+  }
+
+  std::memcpy(&header, memory, sizeof(header));
+  if (header.version != version)
+  {
+    throw "Unsupported binary games version " + std::to_string(header.version);
+  }
+
+  if (header.players >= UINT32_MAX >> 2 || header.name_bytes > length || header.games > length)
+  {
+    throw std::string("Binary games file is corrupt");
+  }
+
+  // the sections are multiples of 8 bytes, so in a mapped file they are
+  // all suitably aligned
+  size_t offsets_start = sizeof(header);
+  size_t names_start = offsets_start + (header.players + 1) * sizeof(uint64_t);
+  size_t games_start = names_start + header.name_bytes + padding(header.name_bytes);
+  size_t end = games_start + header.games * sizeof(BinaryGame);
+
+  if (end > length)
+  {
+    throw std::string("Binary games file is truncated");
+  }
+
+  offsets_ = std::span(reinterpret_cast<const uint64_t*>(memory + offsets_start), header.players + 1);
+  names_ = memory + names_start;
+  games_ = std::span(reinterpret_cast<const BinaryGame*>(memory + games_start), header.games);
+
+  for (size_t i = 0; i != header.players; ++i)
+  {
+    if (offsets_[i] > offsets_[i + 1] || offsets_[i + 1] > header.name_bytes)
+    {
+      throw std::string("Binary games file has a corrupt name table");
+    }
+  }
+}
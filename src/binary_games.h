@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// A compact form of a games file, so that rerunning on the same history
+// doesn't have to parse text and hash names again. The layout is:
+//
+//   BinaryGamesHeader
+//   uint64_t name_offsets[players + 1]
+//   char names[name_bytes]
+//   padding to 8 bytes
+//   BinaryGame games[games]
+//
+// Players are numbered by their position in the name table.
+
+struct BinaryGamesHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t players;
+  uint64_t name_bytes;
+  uint64_t games;
+};
+
+struct BinaryGame
+{
+  uint32_t white;
+  // black << 2 | result
+  uint32_t black_result;
+
+  uint32_t black() const
+  {
+    return black_result >> 2;
+  }
+
+  char result() const
+  {
+    return "wbd?"[black_result & 3];
+  }
+};
+
+inline BinaryGame make_binary_game(uint32_t white, uint32_t black, char result)
+{
+  uint32_t code = result == 'w' ? 0 : result == 'b' ? 1 : 2;
+  return {white, black << 2 | code};
+}
+
+bool is_binary_games(const char* memory, size_t length);
+
+void write_binary_games(const char* file, const std::vector<std::string_view>& names,
+  const std::vector<BinaryGame>& games);
+
+// The contents of a binary games file in memory. Throws if the data isn't
+// a complete binary games file.
+class BinaryGamesView
+{
+  public:
+  BinaryGamesView(const char* memory, size_t length);
+
+  size_t players() const
+  {
+    return offsets_.size() - 1;
+  }
+
+  size_t name_bytes() const
+  {
+    return offsets_.back();
+  }
+
+  std::string_view name(size_t player) const
+  {
+    return std::string_view(names_ + offsets_[player], names_ + offsets_[player + 1]);
+  }
+
+  std::span<const BinaryGame> games() const
+  {
+    return games_;
+  }
+
+  private:
+  std::span<const uint64_t> offsets_;
+  const char* names_;
+  std::span<const BinaryGame> games_;
+};
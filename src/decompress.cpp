@@ -0,0 +1,170 @@
+#include "decompress.h"
+
+#include <algorithm>
+#include <climits>
+#include <string>
+
+#include <zlib.h>
+
+#ifdef RATINGS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+
+class GzipSource : public ByteSource
+{
+  public:
+  GzipSource(const char* memory, size_t length)
+  : next_(memory)
+  , end_(memory + length)
+  {
+    // 32 lets zlib detect gzip or zlib headers
+    if (inflateInit2(&stream_, 15 + 32) != Z_OK)
+    {
+      throw std::string("Unable to initialise zlib");
+    }
+  }
+
+  ~GzipSource()
+  {
+    inflateEnd(&stream_);
+  }
+
+  size_t read(char* buffer, size_t size) override
+  {
+    stream_.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream_.avail_out = std::min<size_t>(size, UINT_MAX);
+
+    // inflate can hold back output after consuming all of its input, so it
+    // is called until the stream ends rather than until the input runs out
+    while (stream_.avail_out != 0 && !finished_)
+    {
+      if (stream_.avail_in == 0 && next_ != end_)
+      {
+        auto in = std::min<size_t>(end_ - next_, UINT_MAX);
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(next_));
+        stream_.avail_in = in;
+        next_ += in;
+      }
+
+      auto result = inflate(&stream_, Z_NO_FLUSH);
+      if (result == Z_STREAM_END)
+      {
+        // concatenated gzip members are one stream
+        if (stream_.avail_in == 0 && next_ == end_)
+        {
+          finished_ = true;
+        }
+        else
+        {
+          inflateReset(&stream_);
+        }
+      }
+      else if (result == Z_BUF_ERROR && stream_.avail_in == 0 && next_ == end_)
+      {
+        throw std::string("Truncated gzip input");
+      }
+      else if (result != Z_OK && result != Z_BUF_ERROR)
+      {
+        throw std::string("Corrupt gzip input: ") +
+          (stream_.msg != nullptr ? stream_.msg : "unknown error");
+      }
+    }
+
+    return reinterpret_cast<char*>(stream_.next_out) - buffer;
+  }
+
+  private:
+  z_stream stream_{};
+  const char* next_;
+  const char* end_;
+  bool finished_ = false;
+};
+
+#ifdef RATINGS_HAVE_ZSTD
+class ZstdSource : public ByteSource
+{
+  public:
+  ZstdSource(const char* memory, size_t length)
+  : context_(ZSTD_createDCtx())
+  , input_{memory, length, 0}
+  {
+    if (context_ == nullptr)
+    {
+      throw std::string("Unable to initialise zstd");
+    }
+
+    // allow the large windows used by --long compression
+    ZSTD_DCtx_setParameter(context_, ZSTD_d_windowLogMax, 31);
+  }
+
+  ~ZstdSource()
+  {
+    ZSTD_freeDCtx(context_);
+  }
+
+  size_t read(char* buffer, size_t size) override
+  {
+    ZSTD_outBuffer output{buffer, size, 0};
+
+    // a full output buffer means the decoder may still be holding data, even
+    // once all of the input has been consumed
+    while (output.pos != output.size && (input_.pos != input_.size || pending_))
+    {
+      auto before = output.pos;
+      auto result = ZSTD_decompressStream(context_, &output, &input_);
+      if (ZSTD_isError(result))
+      {
+        throw std::string("Corrupt zstd input: ") + ZSTD_getErrorName(result);
+      }
+      frame_incomplete_ = result != 0;
+
+      pending_ = output.pos == output.size;
+      if (input_.pos == input_.size && output.pos == before)
+      {
+        pending_ = false;
+      }
+    }
+
+    // zero from the decoder means a frame just ended, anything else that it
+    // needs more input
+    if (input_.pos == input_.size && !pending_ && frame_incomplete_)
+    {
+      throw std::string("Truncated zstd input");
+    }
+
+    return output.pos;
+  }
+
+  private:
+  ZSTD_DCtx* context_;
+  ZSTD_inBuffer input_;
+  bool pending_ = false;
+  bool frame_incomplete_ = false;
+};
+#endif
+
+}
+
+std::unique_ptr<ByteSource> open_decompressor(const char* memory, size_t length)
+{
+  auto* bytes = reinterpret_cast<const unsigned char*>(memory);
+
+  if (length >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b)
+  {
+    return std::make_unique<GzipSource>(memory, length);
+  }
+
+  if (length >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd)
+  {
+#ifdef RATINGS_HAVE_ZSTD
+    return std::make_unique<ZstdSource>(memory, length);
+#else
+    throw std::string("Input is zstd compressed, but zstd support was not built");
+#endif
+  }
+
+  return nullptr;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <memory>
+
+#include "stream_reader.h"
+
+// A ByteSource that decompresses the gzip or zstd data in [memory,
+// memory + length), or nullptr if the data doesn't start with the magic
+// number of a supported format. The memory must outlive the source.
+std::unique_ptr<ByteSource> open_decompressor(const char* memory, size_t length);
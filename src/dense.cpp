@@ -0,0 +1,144 @@
+#include "ratings.h"
+#include "step_sizes.h"
+#include "timer.h"
+
+#include <cmath>
+
+// Newton's method with a dense Hessian and a Cholesky factorisation, for
+// pools of a few hundred players, where that costs less than starting any
+// threads. It is the same step as the Newton solver, on the log ratings, but
+// solved directly instead of with CG.
+
+namespace
+{
+
+constexpr int max_iterations = 100;
+
+// The Hessian is a graph Laplacian, which is singular along the constant
+// vector of each connected component. A small ridge makes it positive
+// definite, and the errors sum to zero over each component, so it changes
+// nothing but the constant part of the step.
+constexpr double ridge = 1e-9;
+
+// Factors the n by n matrix a in place into its lower Cholesky factor.
+// Returns false if it isn't positive definite. Each column updates the rest
+// of the matrix a row at a time, so the inner loop is a contiguous multiply
+// add that vectorises, rather than a dot product.
+bool cholesky(std::vector<double>& a, size_t n)
+{
+  std::vector<double> column(n);
+  for (size_t j = 0; j != n; ++j)
+  {
+    double diagonal = a[j * n + j];
+    if (diagonal <= 0)
+    {
+      return false;
+    }
+
+    diagonal = std::sqrt(diagonal);
+    a[j * n + j] = diagonal;
+
+    for (size_t i = j + 1; i != n; ++i)
+    {
+      a[i * n + j] /= diagonal;
+      column[i] = a[i * n + j];
+    }
+
+    for (size_t i = j + 1; i != n; ++i)
+    {
+      auto factor = column[i];
+      auto* row = &a[i * n];
+      for (size_t k = j + 1; k <= i; ++k)
+      {
+        row[k] -= factor * column[k];
+      }
+    }
+  }
+
+  return true;
+}
+
+// Solves L L' x = b in place, given the factor from cholesky.
+void cholesky_solve(const std::vector<double>& l, size_t n, std::vector<double>& b)
+{
+  for (size_t i = 0; i != n; ++i)
+  {
+    double sum = b[i];
+    for (size_t k = 0; k != i; ++k)
+    {
+      sum -= l[i * n + k] * b[k];
+    }
+    b[i] = sum / l[i * n + i];
+  }
+
+  for (size_t i = n; i-- != 0;)
+  {
+    double sum = b[i];
+    for (size_t k = i + 1; k != n; ++k)
+    {
+      sum -= l[k * n + i] * b[k];
+    }
+    b[i] = sum / l[i * n + i];
+  }
+}
+
+}
+
+int RatingsCalc::solve_dense()
+{
+  Timer timer;
+  timer.start();
+
+  auto n = ratings_.size();
+  std::vector<double> hessian(n * n);
+  std::vector<double> step(n);
+
+  int i;
+  for (i = 0; i != max_iterations && !out_of_budget(i); ++i)
+  {
+    error_norms_ = calculate_errors(0, n);
+    if (converged())
+    {
+      break;
+    }
+
+    std::fill(hessian.begin(), hessian.end(), 0);
+    double largest = 0;
+    for (size_t p = 0; p != n; ++p)
+    {
+      auto rating = ratings_[p];
+      for (auto j = game_indexes_[p]; j != game_indexes_[p+1]; ++j)
+      {
+        auto o = opp_index_[j];
+        auto opponent = ratings_[o];
+        auto total = rating + opponent;
+        auto weight = opp_played_[j] * rating * opponent / (total * total);
+        hessian[p * n + p] += weight;
+        hessian[p * n + o] -= weight;
+      }
+      largest = std::max(largest, hessian[p * n + p]);
+    }
+
+    for (size_t p = 0; p != n; ++p)
+    {
+      hessian[p * n + p] += ridge * largest + std::numeric_limits<double>::min();
+    }
+
+    if (!cholesky(hessian, n))
+    {
+      throw std::string("Dense Hessian is not positive definite");
+    }
+
+    std::copy(errors_.begin(), errors_.end(), step.begin());
+    cholesky_solve(hessian, n, step);
+
+    for (size_t p = 0; p != n; ++p)
+    {
+      ratings_[p] *= std::exp(std::clamp(step[p], -max_log_step, max_log_step));
+    }
+  }
+
+  timer.stop("dense newton");
+
+  return i;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <exception>
+#include <string_view>
+#include <vector>
+
+#include <absl/container/flat_hash_map.h>
+
+// The games parsed out of one piece of the input. Players are numbered in
+// the order they are first seen in the chunk, so that merging chunks in file
+// order assigns the same global ids as a serial read would.
+class GameChunk
+{
+  public:
+  struct Game
+  {
+    int white;
+    int black;
+    char result;
+  };
+
+  void add_game(std::string_view white, std::string_view black, char result)
+  {
+    auto w = local_id(white);
+    auto b = local_id(black);
+    games_.push_back({w, b, result});
+  }
+
+  const std::vector<std::string_view>& names() const
+  {
+    return names_;
+  }
+
+  const std::vector<Game>& games() const
+  {
+    return games_;
+  }
+
+  // Parsing runs on the thread pool, so an exception is stored here and
+  // rethrown by whoever merges the chunk.
+  void set_error(std::exception_ptr error)
+  {
+    error_ = error;
+  }
+
+  void check() const
+  {
+    if (error_)
+    {
+      std::rethrow_exception(error_);
+    }
+  }
+
+  private:
+  int local_id(std::string_view name)
+  {
+    auto inserted = ids_.try_emplace(name, names_.size());
+    if (inserted.second)
+    {
+      names_.push_back(name);
+    }
+
+    return inserted.first->second;
+  }
+
+  absl::flat_hash_map<std::string_view, int> ids_;
+  std::vector<std::string_view> names_;
+  std::vector<Game> games_;
+  std::exception_ptr error_;
+};
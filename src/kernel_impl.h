@@ -0,0 +1,669 @@
+#pragma once
+
+// The hot loops, included by kernels.cpp, kernels_avx2.cpp and
+// kernels_avx512.cpp, which are each compiled for their own instruction
+// set and use the widest code here that it allows. Everything is in an
+// anonymous namespace, so the copies built for different instruction sets
+// stay apart instead of being merged by the linker. For the same reason
+// the loops stick to builtins over out of line library helpers.
+
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <type_traits>
+
+#include "kernels.h"
+#include "rating_updates.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// GCC 12 warns that the intrinsics' own undefined sources may be used
+// uninitialised
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+namespace
+{
+
+// The term n * r / (r + r_j) of one opponent. In float it divides before
+// multiplying by the games, so a large rating can't overflow. In the log
+// domain the ratings are x = ln r, and the term is the logistic
+// n / (1 + e^(x_j - x)), which is only done in double.
+template <bool log_domain>
+double term(double rating, int games, double opponent)
+{
+  if constexpr (log_domain)
+  {
+    return games / (1 + std::exp(opponent - rating));
+  }
+  else
+  {
+    return expected_score(rating, games, opponent);
+  }
+}
+
+template <bool log_domain>
+float term(float rating, int games, float opponent)
+{
+  static_assert(!log_domain, "the log domain is double only");
+  return games * (rating / (rating + opponent));
+}
+
+// The expected score sum(n_j * r / (r + r_j)) of a player with rating r,
+// over its count opponents, in unroll separate sums to hide the latency of
+// the adds. The terms are added in double whatever Real is. With one sum
+// the terms are added in order.
+template <typename Real, int unroll, bool log_domain>
+double expected_scalar(Real rating, const int* opponents, const int* played,
+  const Real* ratings, int count)
+{
+  double sums[unroll] = {};
+  int j = 0;
+  for (; j + unroll <= count; j += unroll)
+  {
+    for (int u = 0; u != unroll; ++u)
+    {
+      sums[u] += term<log_domain>(rating, played[j+u], ratings[opponents[j+u]]);
+    }
+  }
+
+  for (; j != count; ++j)
+  {
+    sums[0] += term<log_domain>(rating, played[j], ratings[opponents[j]]);
+  }
+
+  for (int u = 1; u != unroll; ++u)
+  {
+    sums[0] += sums[u];
+  }
+
+  return sums[0];
+}
+
+// The vector versions fetch the opponents' ratings with hardware gathers.
+// Each instruction set and precision has a struct with the steps:
+// broadcast the rating, add the terms of a full vector of opponents, or of
+// the last partial one, to a sum, and reduce the sum. The partial vector is
+// masked: the lanes past the end have no games against an opponent rated 1,
+// so they add zero even for a zero rating. The float versions gather from a
+// float copy of the ratings, half the bytes, and work out the terms in
+// float, but add them up in double.
+//
+// They add in a different order from the scalar loop, so the results differ
+// from it by rounding.
+
+// e^d for the vector log domain kernels, as 2^k e^f with |f| <= ln 2 / 2,
+// and e^f from its Taylor series to f^10, which is within 3e-13 of it. d is
+// clamped to +-708, where the logistic is 0 or 1 anyway.
+constexpr double exp_limit = 708;
+constexpr double log2e = 1.4426950408889634;
+// ln 2 in two parts, so that k ln 2 is exact for the reduction
+constexpr double ln2_high = 6.93147180369123816490e-01;
+constexpr double ln2_low = 1.90821492927058770002e-10;
+constexpr int exp_degree = 10;
+constexpr double exp_coefficients[exp_degree + 1] = {1, 1, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120,
+  1.0 / 720, 1.0 / 5040, 1.0 / 40320, 1.0 / 362880, 1.0 / 3628800};
+
+#if defined(__AVX2__)
+inline __m256d exp_avx2(__m256d d)
+{
+  d = _mm256_min_pd(_mm256_max_pd(d, _mm256_set1_pd(-exp_limit)), _mm256_set1_pd(exp_limit));
+  auto k = _mm256_round_pd(_mm256_mul_pd(d, _mm256_set1_pd(log2e)),
+    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  auto f = _mm256_fnmadd_pd(k, _mm256_set1_pd(ln2_high), d);
+  f = _mm256_fnmadd_pd(k, _mm256_set1_pd(ln2_low), f);
+
+  // Estrin's scheme, which has a shorter chain of dependent steps than
+  // Horner's
+  auto c = [](int i) {
+    return _mm256_set1_pd(exp_coefficients[i]);
+  };
+  auto f2 = _mm256_mul_pd(f, f);
+  auto f4 = _mm256_mul_pd(f2, f2);
+  auto f8 = _mm256_mul_pd(f4, f4);
+  auto low = _mm256_fmadd_pd(_mm256_fmadd_pd(c(3), f, c(2)), f2, _mm256_fmadd_pd(c(1), f, c(0)));
+  auto middle = _mm256_fmadd_pd(_mm256_fmadd_pd(c(7), f, c(6)), f2, _mm256_fmadd_pd(c(5), f, c(4)));
+  auto high = _mm256_fmadd_pd(c(10), f2, _mm256_fmadd_pd(c(9), f, c(8)));
+  auto e = _mm256_fmadd_pd(high, f8, _mm256_fmadd_pd(middle, f4, low));
+
+  // 2^k straight into the exponent bits
+  auto exponent = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k)), _mm256_set1_epi64x(1023));
+  return _mm256_mul_pd(e, _mm256_castsi256_pd(_mm256_slli_epi64(exponent, 52)));
+}
+
+template <typename Real>
+struct Avx2;
+
+template <>
+struct Avx2<double>
+{
+  static constexpr int lanes = 4;
+  using Rating = __m256d;
+  using Sum = __m256d;
+
+  static Rating broadcast(double rating)
+  {
+    return _mm256_set1_pd(rating);
+  }
+
+  static Sum zero()
+  {
+    return _mm256_setzero_pd();
+  }
+
+  template <bool log_domain>
+  static __m256d terms(__m256d n, Rating r, __m256d opponent)
+  {
+    if constexpr (log_domain)
+    {
+      auto one = _mm256_set1_pd(1);
+      return _mm256_div_pd(n, _mm256_add_pd(one, exp_avx2(_mm256_sub_pd(opponent, r))));
+    }
+    else
+    {
+      return _mm256_div_pd(_mm256_mul_pd(n, r), _mm256_add_pd(r, opponent));
+    }
+  }
+
+  template <bool log_domain>
+  static Sum add(Sum sum, Rating r, const int* opponents, const int* played, const double* ratings)
+  {
+    auto index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(opponents));
+    auto opponent = _mm256_i32gather_pd(ratings, index, 8);
+    auto n = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(played)));
+    return _mm256_add_pd(sum, terms<log_domain>(n, r, opponent));
+  }
+
+  template <bool log_domain>
+  static Sum add_partial(Sum sum, Rating r, const int* opponents, const int* played,
+    const double* ratings, int count)
+  {
+    auto mask = _mm_cmplt_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(count));
+    auto index = _mm_maskload_epi32(opponents, mask);
+    auto opponent = _mm256_mask_i32gather_pd(_mm256_set1_pd(1), ratings, index,
+      _mm256_castsi256_pd(_mm256_cvtepi32_epi64(mask)), 8);
+    auto n = _mm256_cvtepi32_pd(_mm_maskload_epi32(played, mask));
+    return _mm256_add_pd(sum, terms<log_domain>(n, r, opponent));
+  }
+
+  static Sum combine(Sum a, Sum b)
+  {
+    return _mm256_add_pd(a, b);
+  }
+
+  static double reduce(Sum sum)
+  {
+    auto half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+  }
+};
+
+template <>
+struct Avx2<float>
+{
+  static constexpr int lanes = 8;
+  using Rating = __m256;
+  // the low and high four terms
+  struct Sum
+  {
+    __m256d low;
+    __m256d high;
+  };
+
+  static Rating broadcast(float rating)
+  {
+    return _mm256_set1_ps(rating);
+  }
+
+  static Sum zero()
+  {
+    return {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  }
+
+  static Sum add_terms(Sum sum, __m256 terms)
+  {
+    return {_mm256_add_pd(sum.low, _mm256_cvtps_pd(_mm256_castps256_ps128(terms))),
+      _mm256_add_pd(sum.high, _mm256_cvtps_pd(_mm256_extractf128_ps(terms, 1)))};
+  }
+
+  template <bool log_domain>
+  static Sum add(Sum sum, Rating r, const int* opponents, const int* played, const float* ratings)
+  {
+    static_assert(!log_domain, "the log domain is double only");
+    auto index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(opponents));
+    auto opponent = _mm256_i32gather_ps(ratings, index, 4);
+    auto n = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(played)));
+    return add_terms(sum, _mm256_mul_ps(n, _mm256_div_ps(r, _mm256_add_ps(r, opponent))));
+  }
+
+  template <bool log_domain>
+  static Sum add_partial(Sum sum, Rating r, const int* opponents, const int* played,
+    const float* ratings, int count)
+  {
+    static_assert(!log_domain, "the log domain is double only");
+    auto mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    auto index = _mm256_maskload_epi32(opponents, mask);
+    auto opponent = _mm256_mask_i32gather_ps(_mm256_set1_ps(1), ratings, index,
+      _mm256_castsi256_ps(mask), 4);
+    auto n = _mm256_cvtepi32_ps(_mm256_maskload_epi32(played, mask));
+    return add_terms(sum, _mm256_mul_ps(n, _mm256_div_ps(r, _mm256_add_ps(r, opponent))));
+  }
+
+  static Sum combine(Sum a, Sum b)
+  {
+    return {_mm256_add_pd(a.low, b.low), _mm256_add_pd(a.high, b.high)};
+  }
+
+  static double reduce(Sum sum)
+  {
+    return Avx2<double>::reduce(_mm256_add_pd(sum.low, sum.high));
+  }
+};
+#endif
+
+#if defined(__AVX512F__)
+inline __m512d exp_avx512(__m512d d)
+{
+  d = _mm512_min_pd(_mm512_max_pd(d, _mm512_set1_pd(-exp_limit)), _mm512_set1_pd(exp_limit));
+  auto k = _mm512_roundscale_pd(_mm512_mul_pd(d, _mm512_set1_pd(log2e)), _MM_FROUND_TO_NEAREST_INT);
+  auto f = _mm512_fnmadd_pd(k, _mm512_set1_pd(ln2_high), d);
+  f = _mm512_fnmadd_pd(k, _mm512_set1_pd(ln2_low), f);
+
+  // Estrin's scheme, which has a shorter chain of dependent steps than
+  // Horner's
+  auto c = [](int i) {
+    return _mm512_set1_pd(exp_coefficients[i]);
+  };
+  auto f2 = _mm512_mul_pd(f, f);
+  auto f4 = _mm512_mul_pd(f2, f2);
+  auto f8 = _mm512_mul_pd(f4, f4);
+  auto low = _mm512_fmadd_pd(_mm512_fmadd_pd(c(3), f, c(2)), f2, _mm512_fmadd_pd(c(1), f, c(0)));
+  auto middle = _mm512_fmadd_pd(_mm512_fmadd_pd(c(7), f, c(6)), f2, _mm512_fmadd_pd(c(5), f, c(4)));
+  auto high = _mm512_fmadd_pd(c(10), f2, _mm512_fmadd_pd(c(9), f, c(8)));
+  auto e = _mm512_fmadd_pd(high, f8, _mm512_fmadd_pd(middle, f4, low));
+
+  return _mm512_scalef_pd(e, k);
+}
+
+template <typename Real>
+struct Avx512;
+
+template <>
+struct Avx512<double>
+{
+  static constexpr int lanes = 8;
+  using Rating = __m512d;
+  using Sum = __m512d;
+
+  static Rating broadcast(double rating)
+  {
+    return _mm512_set1_pd(rating);
+  }
+
+  static Sum zero()
+  {
+    return _mm512_setzero_pd();
+  }
+
+  template <bool log_domain>
+  static __m512d terms(__m512d n, Rating r, __m512d opponent)
+  {
+    if constexpr (log_domain)
+    {
+      auto one = _mm512_set1_pd(1);
+      return _mm512_div_pd(n, _mm512_add_pd(one, exp_avx512(_mm512_sub_pd(opponent, r))));
+    }
+    else
+    {
+      return _mm512_div_pd(_mm512_mul_pd(n, r), _mm512_add_pd(r, opponent));
+    }
+  }
+
+  template <bool log_domain>
+  static Sum add(Sum sum, Rating r, const int* opponents, const int* played, const double* ratings)
+  {
+    auto index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(opponents));
+    auto opponent = _mm512_i32gather_pd(index, ratings, 8);
+    auto n = _mm512_cvtepi32_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(played)));
+    return _mm512_add_pd(sum, terms<log_domain>(n, r, opponent));
+  }
+
+  template <bool log_domain>
+  static Sum add_partial(Sum sum, Rating r, const int* opponents, const int* played,
+    const double* ratings, int count)
+  {
+    __mmask8 mask = (1u << count) - 1;
+    auto index = _mm512_castsi512_si256(_mm512_maskz_loadu_epi32(mask, opponents));
+    auto opponent = _mm512_mask_i32gather_pd(_mm512_set1_pd(1), mask, index, ratings, 8);
+    auto n = _mm512_cvtepi32_pd(_mm512_castsi512_si256(_mm512_maskz_loadu_epi32(mask, played)));
+    return _mm512_add_pd(sum, terms<log_domain>(n, r, opponent));
+  }
+
+  static Sum combine(Sum a, Sum b)
+  {
+    return _mm512_add_pd(a, b);
+  }
+
+  static double reduce(Sum sum)
+  {
+    return _mm512_reduce_add_pd(sum);
+  }
+};
+
+template <>
+struct Avx512<float>
+{
+  static constexpr int lanes = 16;
+  using Rating = __m512;
+  // the low and high eight terms
+  struct Sum
+  {
+    __m512d low;
+    __m512d high;
+  };
+
+  static Rating broadcast(float rating)
+  {
+    return _mm512_set1_ps(rating);
+  }
+
+  static Sum zero()
+  {
+    return {_mm512_setzero_pd(), _mm512_setzero_pd()};
+  }
+
+  static Sum add_terms(Sum sum, __m512 terms)
+  {
+    return {_mm512_add_pd(sum.low, _mm512_cvtps_pd(_mm512_castps512_ps256(terms))),
+      _mm512_add_pd(sum.high, _mm512_cvtps_pd(
+        _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(terms), 1))))};
+  }
+
+  template <bool log_domain>
+  static Sum add(Sum sum, Rating r, const int* opponents, const int* played, const float* ratings)
+  {
+    static_assert(!log_domain, "the log domain is double only");
+    auto index = _mm512_loadu_si512(opponents);
+    auto opponent = _mm512_i32gather_ps(index, ratings, 4);
+    auto n = _mm512_cvtepi32_ps(_mm512_loadu_si512(played));
+    return add_terms(sum, _mm512_mul_ps(n, _mm512_div_ps(r, _mm512_add_ps(r, opponent))));
+  }
+
+  template <bool log_domain>
+  static Sum add_partial(Sum sum, Rating r, const int* opponents, const int* played,
+    const float* ratings, int count)
+  {
+    static_assert(!log_domain, "the log domain is double only");
+    __mmask16 mask = (1u << count) - 1;
+    auto index = _mm512_maskz_loadu_epi32(mask, opponents);
+    auto opponent = _mm512_mask_i32gather_ps(_mm512_set1_ps(1), mask, index, ratings, 4);
+    auto n = _mm512_cvtepi32_ps(_mm512_maskz_loadu_epi32(mask, played));
+    return add_terms(sum, _mm512_mul_ps(n, _mm512_div_ps(r, _mm512_add_ps(r, opponent))));
+  }
+
+  static Sum combine(Sum a, Sum b)
+  {
+    return {_mm512_add_pd(a.low, b.low), _mm512_add_pd(a.high, b.high)};
+  }
+
+  static double reduce(Sum sum)
+  {
+    return _mm512_reduce_add_pd(_mm512_add_pd(sum.low, sum.high));
+  }
+};
+#endif
+
+template <typename Vector, int unroll, bool log_domain, typename Real>
+double expected_vector(Real rating, const int* opponents, const int* played,
+  const Real* ratings, int count)
+{
+  constexpr int lanes = Vector::lanes;
+  auto r = Vector::broadcast(rating);
+  typename Vector::Sum sums[unroll];
+  for (auto& sum : sums)
+  {
+    sum = Vector::zero();
+  }
+
+  int j = 0;
+  for (; j + unroll * lanes <= count; j += unroll * lanes)
+  {
+    for (int u = 0; u != unroll; ++u)
+    {
+      sums[u] = Vector::template add<log_domain>(sums[u], r, opponents + j + u * lanes, played + j + u * lanes, ratings);
+    }
+  }
+
+  for (; j + lanes <= count; j += lanes)
+  {
+    sums[0] = Vector::template add<log_domain>(sums[0], r, opponents + j, played + j, ratings);
+  }
+
+  if (j != count)
+  {
+    sums[0] = Vector::template add_partial<log_domain>(sums[0], r, opponents + j, played + j, ratings, count - j);
+  }
+
+  for (int u = 1; u != unroll; ++u)
+  {
+    sums[0] = Vector::combine(sums[0], sums[u]);
+  }
+
+  return Vector::reduce(sums[0]);
+}
+
+// the widest version this file is compiled for
+template <typename Real, int unroll, bool log_domain>
+double expected(Real rating, const int* opponents, const int* played, const Real* ratings, int count)
+{
+#if defined(__AVX512F__)
+  return expected_vector<Avx512<Real>, unroll, log_domain>(rating, opponents, played, ratings, count);
+#elif defined(__AVX2__)
+  return expected_vector<Avx2<Real>, unroll, log_domain>(rating, opponents, played, ratings, count);
+#else
+  return expected_scalar<Real, unroll, log_domain>(rating, opponents, played, ratings, count);
+#endif
+}
+
+// The error kernel for one ErrorKernelConfig. The choices are all template
+// parameters, so a feature that is off costs nothing in the loop.
+template <typename Real, int unroll, bool max_per_player, bool log_domain>
+ErrorNorms errors(const KernelGraph& graph, double* errors, int start, int end)
+{
+  const Real* ratings;
+  if constexpr (std::is_same_v<Real, float>)
+  {
+    ratings = graph.float_ratings;
+  }
+  else
+  {
+    ratings = graph.ratings;
+  }
+
+  ErrorNorms norms;
+  for (int p = start; p != end; ++p)
+  {
+    auto first = graph.game_indexes[p];
+    double e = graph.scores[p] - expected<Real, unroll, log_domain>(ratings[p], graph.opponents + first,
+      graph.opponent_games + first, ratings, graph.game_indexes[p+1] - first);
+    errors[p] = e;
+
+    auto magnitude = std::fabs(e);
+    norms.total += magnitude;
+    if constexpr (max_per_player)
+    {
+      if (graph.played[p] != 0)
+      {
+        auto per_game = magnitude / graph.played[p];
+        norms.max_per_player = per_game > norms.max_per_player ? per_game : norms.max_per_player;
+      }
+    }
+  }
+
+  return norms;
+}
+
+template <typename Real, int unroll, bool max_per_player>
+ErrorKernel error_kernel_domain(const ErrorKernelConfig& config)
+{
+  if (!config.log_domain)
+  {
+    return errors<Real, unroll, max_per_player, false>;
+  }
+
+  // the log domain is double only
+  if constexpr (std::is_same_v<Real, double>)
+  {
+    return errors<Real, unroll, max_per_player, true>;
+  }
+  else
+  {
+    return nullptr;
+  }
+}
+
+template <typename Real, int unroll>
+ErrorKernel error_kernel_features(const ErrorKernelConfig& config)
+{
+  return config.max_per_player ? error_kernel_domain<Real, unroll, true>(config)
+    : error_kernel_domain<Real, unroll, false>(config);
+}
+
+template <typename Real>
+ErrorKernel error_kernel_unrolled(const ErrorKernelConfig& config)
+{
+  switch (config.unroll)
+  {
+    case 4:
+    return error_kernel_features<Real, 4>(config);
+    case 2:
+    return error_kernel_features<Real, 2>(config);
+    default:
+    return error_kernel_features<Real, 1>(config);
+  }
+}
+
+ErrorKernel error_kernel(const ErrorKernelConfig& config)
+{
+  return config.precision == Precision::Float ? error_kernel_unrolled<float>(config)
+    : error_kernel_unrolled<double>(config);
+}
+
+// pow isn't vectorised, so these are the same loops in every build
+void adjust(const KernelGraph& graph, double* ratings, const double* errors, double K,
+  size_t start, size_t end)
+{
+  for (size_t p = start; p != end; ++p)
+  {
+    ratings[p] = kstep_rating(ratings[p], errors[p], graph.played[p], K);
+  }
+}
+
+void adjust_mm(const KernelGraph& graph, double* ratings, const double* errors,
+  size_t start, size_t end)
+{
+  for (size_t p = start; p != end; ++p)
+  {
+    ratings[p] = mm_rating(ratings[p], graph.scores[p], errors[p], graph.played[p]);
+  }
+}
+
+// the same updates on log ratings
+void adjust_log(const KernelGraph& graph, double* ratings, const double* errors, double K,
+  size_t start, size_t end)
+{
+  for (size_t p = start; p != end; ++p)
+  {
+    ratings[p] = kstep_log_rating(ratings[p], errors[p], graph.played[p], K);
+  }
+}
+
+void adjust_mm_log(const KernelGraph& graph, double* ratings, const double* errors,
+  size_t start, size_t end)
+{
+  for (size_t p = start; p != end; ++p)
+  {
+    ratings[p] = mm_log_rating(ratings[p], graph.scores[p], errors[p], graph.played[p]);
+  }
+}
+
+// Bitmasks of the '\n' and ':' bytes in the block starting at p.
+#if defined(__AVX512BW__)
+constexpr int block_size = 64;
+
+inline uint64_t delimiter_mask(const char* p)
+{
+  auto block = _mm512_loadu_si512(p);
+  return _mm512_cmpeq_epi8_mask(block, _mm512_set1_epi8('\n'))
+    | _mm512_cmpeq_epi8_mask(block, _mm512_set1_epi8(':'));
+}
+#elif defined(__AVX2__)
+constexpr int block_size = 32;
+
+inline uint64_t delimiter_mask(const char* p)
+{
+  auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  auto newlines = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'));
+  auto colons = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(':'));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(newlines, colons)));
+}
+#elif defined(__SSE2__)
+constexpr int block_size = 16;
+
+inline uint64_t delimiter_mask(const char* p)
+{
+  auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  auto newlines = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+  auto colons = _mm_cmpeq_epi8(block, _mm_set1_epi8(':'));
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(newlines, colons)));
+}
+#else
+constexpr int block_size = 8;
+
+inline uint64_t delimiter_mask(const char* p)
+{
+  uint64_t mask = 0;
+  for (int i = 0; i != block_size; ++i)
+  {
+    mask |= static_cast<uint64_t>(p[i] == '\n' || p[i] == ':') << i;
+  }
+  return mask;
+}
+#endif
+
+size_t delimiters(const char* begin, size_t length, uint32_t* positions)
+{
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + block_size <= length; i += block_size)
+  {
+    auto mask = delimiter_mask(begin + i);
+    while (mask != 0)
+    {
+      positions[count++] = i + __builtin_ctzll(mask);
+      mask &= mask - 1;
+    }
+  }
+
+  for (; i != length; ++i)
+  {
+    if (begin[i] == '\n' || begin[i] == ':')
+    {
+      positions[count++] = i;
+    }
+  }
+
+  return count;
+}
+
+// The table of the loops this file was compiled for.
+constexpr Kernels make_kernels()
+{
+  return {error_kernel, adjust, adjust_mm, adjust_log, adjust_mm_log, delimiters};
+}
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,82 @@
+// The scalar kernels, built for the baseline instruction set, and the
+// choice between the builds. See kernel_impl.h.
+#include "kernel_impl.h"
+
+extern const Kernels scalar_kernels = make_kernels();
+
+bool isa_supported(Isa isa)
+{
+  switch (isa)
+  {
+    case Isa::Scalar:
+    return true;
+#if defined(RATINGS_X86_KERNELS)
+    case Isa::Avx2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case Isa::Avx512:
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    default:
+    return false;
+  }
+}
+
+Isa best_isa()
+{
+  for (auto isa : {Isa::Avx512, Isa::Avx2})
+  {
+    if (isa_supported(isa))
+    {
+      return isa;
+    }
+  }
+
+  return Isa::Scalar;
+}
+
+Isa isa_from_name(const std::string& name)
+{
+  for (auto isa : {Isa::Scalar, Isa::Avx2, Isa::Avx512})
+  {
+    if (name == isa_name(isa))
+    {
+      if (!isa_supported(isa))
+      {
+        throw "This CPU or build doesn't support " + name;
+      }
+      return isa;
+    }
+  }
+
+  throw "Unknown instruction set " + name;
+}
+
+const char* isa_name(Isa isa)
+{
+  switch (isa)
+  {
+    case Isa::Scalar:
+    return "scalar";
+    case Isa::Avx2:
+    return "avx2";
+    case Isa::Avx512:
+    return "avx512";
+  }
+
+  return "unknown";
+}
+
+const Kernels& kernels_for(Isa isa)
+{
+  switch (isa)
+  {
+#if defined(RATINGS_X86_KERNELS)
+    case Isa::Avx2:
+    return avx2_kernels;
+    case Isa::Avx512:
+    return avx512_kernels;
+#endif
+    default:
+    return scalar_kernels;
+  }
+}
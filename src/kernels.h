@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The instruction sets the hot loops are built for. One binary carries all
+// of them, and uses the best the CPU supports unless told otherwise.
+enum class Isa
+{
+  Scalar,
+  Avx2,
+  Avx512,
+};
+
+bool isa_supported(Isa isa);
+Isa best_isa();
+// Throws if the name is unknown or this CPU can't run it.
+Isa isa_from_name(const std::string& name);
+const char* isa_name(Isa isa);
+
+// The norms of the errors from one error pass.
+struct ErrorNorms
+{
+  double total = 0;
+  double max_per_player = 0;
+
+  ErrorNorms& operator+=(const ErrorNorms& other)
+  {
+    total += other.total;
+    max_per_player = std::max(max_per_player, other.max_per_player);
+    return *this;
+  }
+};
+
+// The game graph as the kernels see it: each player's opponents and the
+// games against each, in compressed rows, and the ratings the error pass
+// reads.
+struct KernelGraph
+{
+  const int64_t* game_indexes;
+  const int* opponents;
+  const int* opponent_games;
+  const double* scores;
+  const int* played;
+  const double* ratings;
+  const float* float_ratings;
+};
+
+enum class Precision
+{
+  Double,
+  // the error pass reads the float copy of the ratings
+  Float,
+};
+
+// The choices an error kernel is specialised on, which are fixed for a
+// solve.
+struct ErrorKernelConfig
+{
+  Precision precision = Precision::Double;
+  // the separate sums per player, 1, 2 or 4
+  int unroll = 1;
+  // track the largest error per game of any player
+  bool max_per_player = true;
+  // the ratings are natural logs, double precision only
+  bool log_domain = false;
+};
+
+// Sets errors[p] to the score minus the expected score, for p in
+// [start, end), and returns their norms.
+using ErrorKernel = ErrorNorms (*)(const KernelGraph& graph, double* errors, int start, int end);
+
+// The hot loops for one instruction set, see kernel_impl.h.
+struct Kernels
+{
+  // The error kernel specialised for the config, or null for a combination
+  // there isn't one for.
+  ErrorKernel (*error_kernel)(const ErrorKernelConfig& config);
+  // The kstep update r *= 10^(K e / played) for p in [start, end).
+  void (*adjust)(const KernelGraph& graph, double* ratings, const double* errors, double K,
+    size_t start, size_t end);
+  // The MM update r *= W / (W - e) for p in [start, end).
+  void (*adjust_mm)(const KernelGraph& graph, double* ratings, const double* errors,
+    size_t start, size_t end);
+  // The same updates on natural log ratings.
+  void (*adjust_log)(const KernelGraph& graph, double* ratings, const double* errors, double K,
+    size_t start, size_t end);
+  void (*adjust_mm_log)(const KernelGraph& graph, double* ratings, const double* errors,
+    size_t start, size_t end);
+  // Writes the offsets of the '\n' and ':' bytes in [begin, begin + length)
+  // to positions, in order, and returns how many there were.
+  size_t (*delimiters)(const char* begin, size_t length, uint32_t* positions);
+};
+
+const Kernels& kernels_for(Isa isa);
+
+extern const Kernels scalar_kernels;
+extern const Kernels avx2_kernels;
+extern const Kernels avx512_kernels;
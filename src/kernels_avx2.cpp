@@ -0,0 +1,4 @@
+// The kernels built with AVX2 and FMA, see kernel_impl.h.
+#include "kernel_impl.h"
+
+extern const Kernels avx2_kernels = make_kernels();
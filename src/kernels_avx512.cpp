@@ -0,0 +1,4 @@
+// The kernels built with AVX-512, see kernel_impl.h.
+#include "kernel_impl.h"
+
+extern const Kernels avx512_kernels = make_kernels();
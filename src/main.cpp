@@ -10,7 +10,12 @@
 #include "ratings.h"
 #include "timer.h"
 
+// GCC 12 warns about a memcpy in the integer parsing of cxxopts that can't
+// overlap
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wrestrict"
 #include "cxxopts.hpp"
+#pragma GCC diagnostic pop
 
 int main(int argc, const char** argv)
 {
@@ -27,13 +32,135 @@ int main(int argc, const char** argv)
       ("gpu", "Use GPU calculation", cxxopts::value<bool>())
       ("w,wadv", "Set white advantage", cxxopts::value<double>())
       ("games", "Games file to read from", cxxopts::value<std::string>())
+      ("pgn", "Read the games file as PGN, implied by a .pgn extension", cxxopts::value<bool>())
+      ("convert", "Write the games to this file in binary form and exit", cxxopts::value<std::string>())
+      ("map-window", "Map the games file this many MiB at a time to bound memory use", cxxopts::value<size_t>())
+      ("memory-report", "Print memory use after each phase", cxxopts::value<bool>())
+      ("solver", "Rating solver: adaptive, kstep, mm or newton", cxxopts::value<std::string>()->default_value("adaptive"))
+      ("anderson", "Anderson acceleration of kstep or mm, mixing this many previous steps", cxxopts::value<int>())
+      ("async", "Run kstep or mm as asynchronous Gauss-Seidel, updating ratings in place", cxxopts::value<bool>())
+      ("push", "Run kstep or mm from a queue of the players with the largest errors", cxxopts::value<bool>())
+      ("active-set", "Only update kstep or mm players whose errors are still large", cxxopts::value<bool>())
+      ("multigrid", "Warm start the solver with aggregation multigrid", cxxopts::value<bool>())
+      ("isa", "Instruction set of the kernels: scalar, avx2 or avx512, the best the CPU has by default", cxxopts::value<std::string>())
+      ("log-ratings", "Solve with the ratings as natural logs, for adaptive, kstep or mm", cxxopts::value<bool>())
+      ("float-ratings", "Solve with float ratings in the error pass, then refine in double", cxxopts::value<bool>())
+      ("unroll", "Separate sums per player in the error kernel: 1, 2 or 4", cxxopts::value<int>())
+      ("bench-kernels", "Time the error kernel of each instruction set on the games and exit", cxxopts::value<bool>())
+      ("tolerance", "Stop when the total error is below this, 0.5 unless another tolerance is set", cxxopts::value<double>())
+      ("tolerance-per-game", "Stop when the total error divided by the games is below this", cxxopts::value<double>())
+      ("tolerance-per-player", "Stop when every player's error divided by their games is below this", cxxopts::value<double>())
+      ("max-iterations", "Stop after this many iterations", cxxopts::value<int>())
+      ("time-limit", "Stop after this many seconds of solving", cxxopts::value<double>())
       ;
 
     options.parse_positional({"games"});
     auto parsed = options.parse(argc, argv);
 
-    RatingsCalc calc;
-    calc.read_games(argv[1]);
+    if (!parsed.count("games"))
+    {
+      std::cerr << "Provide input file" << std::endl;
+      return 1;
+    }
+
+    auto games = parsed["games"].as<std::string>();
+
+    auto format = InputFormat::Lines;
+    if (parsed.count("pgn") || games.ends_with(".pgn") || games.ends_with(".pgn.gz")
+      || games.ends_with(".pgn.zst"))
+    {
+      format = InputFormat::Pgn;
+    }
+
+    RatingsOptions ratings_options;
+    if (parsed.count("map-window"))
+    {
+      ratings_options.map_window = parsed["map-window"].as<size_t>() << 20;
+    }
+
+    ratings_options.memory_report = parsed.count("memory-report") != 0;
+    ratings_options.async = parsed.count("async") != 0;
+    ratings_options.push = parsed.count("push") != 0;
+    ratings_options.active_set = parsed.count("active-set") != 0;
+    ratings_options.multigrid = parsed.count("multigrid") != 0;
+    ratings_options.float_ratings = parsed.count("float-ratings") != 0;
+    ratings_options.log_ratings = parsed.count("log-ratings") != 0;
+    ratings_options.solver = solver_from_name(parsed["solver"].as<std::string>());
+    if (parsed.count("anderson"))
+    {
+      ratings_options.anderson = parsed["anderson"].as<int>();
+    }
+
+    if (parsed.count("isa"))
+    {
+      ratings_options.isa = isa_from_name(parsed["isa"].as<std::string>());
+    }
+
+    if (parsed.count("unroll"))
+    {
+      ratings_options.unroll = parsed["unroll"].as<int>();
+      if (ratings_options.unroll != 1 && ratings_options.unroll != 2 && ratings_options.unroll != 4)
+      {
+        throw std::string("--unroll must be 1, 2 or 4");
+      }
+    }
+
+    auto& convergence = ratings_options.convergence;
+    if (parsed.count("tolerance-per-game") || parsed.count("tolerance-per-player"))
+    {
+      convergence.total = 0;
+    }
+    if (parsed.count("tolerance"))
+    {
+      convergence.total = parsed["tolerance"].as<double>();
+    }
+    if (parsed.count("tolerance-per-game"))
+    {
+      convergence.mean_per_game = parsed["tolerance-per-game"].as<double>();
+    }
+    if (parsed.count("tolerance-per-player"))
+    {
+      convergence.max_per_player = parsed["tolerance-per-player"].as<double>();
+    }
+    if (parsed.count("max-iterations"))
+    {
+      convergence.max_iterations = parsed["max-iterations"].as<int>();
+    }
+    if (parsed.count("time-limit"))
+    {
+      convergence.time_limit = std::chrono::milliseconds(
+        static_cast<int64_t>(parsed["time-limit"].as<double>() * 1000));
+    }
+
+    bool fixed_point = ratings_options.solver == Solver::KStep || ratings_options.solver == Solver::MM;
+    if (!fixed_point && (ratings_options.anderson > 0 || ratings_options.async
+      || ratings_options.push || ratings_options.active_set))
+    {
+      throw std::string("--anderson, --async, --push and --active-set need --solver kstep or mm");
+    }
+
+    if (ratings_options.log_ratings && (ratings_options.solver == Solver::Newton
+      || ratings_options.anderson > 0 || ratings_options.async || ratings_options.push
+      || ratings_options.active_set || ratings_options.float_ratings))
+    {
+      throw std::string("--log-ratings works with the plain adaptive, kstep and mm solvers");
+    }
+
+    RatingsCalc calc(ratings_options);
+
+    if (parsed.count("convert"))
+    {
+      calc.convert_games(games.c_str(), format, parsed["convert"].as<std::string>().c_str());
+      return 0;
+    }
+
+    calc.read_games(games.c_str(), format);
+
+    if (parsed.count("bench-kernels"))
+    {
+      calc.benchmark_kernels();
+      return 0;
+    }
 
     Timer timer;
     timer.start();
@@ -45,6 +172,11 @@ int main(int argc, const char** argv)
     std::cerr << "Exception caught " << e << std::endl;
     return 1;
   }
+  catch(const cxxopts::exceptions::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
 
   return 0;
 }
@@ -1,54 +1,129 @@
+#pragma once
+
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+// Maps a file for reading, either all at once, or a window at a time for
+// files that are too big to keep resident.
 class MappedFile
 {
   public:
-  MappedFile(const char* file)
+  // With a non zero window nothing is mapped until map_window is called.
+  MappedFile(const char* file, size_t window = 0)
+  : window_(window)
   {
     fd_ = open(file, O_RDONLY);
 
     if (fd_ == -1)
     {
-      throw "Unable to open input file";
+      throw std::string("Unable to open input file ") + file;
     }
 
     struct stat sb;
-    fstat(fd_, &sb);
+    if (fstat(fd_, &sb) == -1)
+    {
+      close(fd_);
+      throw std::string("Unable to stat input file ") + file;
+    }
 
     length_ = sb.st_size;
 
-    mem_ = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd_, 0);
-
-    if (mem_ == nullptr)
+    if (window_ == 0)
     {
-      throw "Unable to mmap input file";
+      map(0, length_);
     }
   }
 
   ~MappedFile()
   {
-    munmap(mem_, length_);
+    unmap();
     close(fd_);
   }
 
-  int length()
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  size_t length()
   {
     return length_;
   }
 
+  // The start of the mapping, which is the whole file unless a window size
+  // was given.
   const char* memory()
   {
-    return reinterpret_cast<const char*>(mem_);
+    return reinterpret_cast<const char*>(mem_) + (offset_ - map_offset_);
+  }
+
+  // Maps up to the window size of the file starting at offset, replacing
+  // the previous window, and returns the mapped bytes.
+  std::string_view map_window(size_t offset)
+  {
+    unmap();
+    auto length = std::min(window_, length_ - offset);
+    map(offset, length);
+
+    // start reading the next window while this one is being parsed
+    if (offset + length < length_)
+    {
+      posix_fadvise(fd_, offset + length, window_, POSIX_FADV_WILLNEED);
+    }
+
+    return std::string_view(memory(), length);
   }
 
   private:
 
   int fd_ = 0;
   void* mem_ = nullptr;
-  int length_ = 0;
-};
+  size_t length_ = 0;
+  size_t window_ = 0;
+
+  // where the mapping starts in the file, rounded down to a page, and the
+  // offset that was asked for
+  size_t map_offset_ = 0;
+  size_t map_length_ = 0;
+  size_t offset_ = 0;
+
+  void map(size_t offset, size_t length)
+  {
+    size_t page = sysconf(_SC_PAGESIZE);
+    offset_ = offset;
+    map_offset_ = offset / page * page;
+    map_length_ = length + (offset - map_offset_);
+
+    if (map_length_ == 0)
+    {
+      return;
+    }
+
+    mem_ = mmap(nullptr, map_length_, PROT_READ, MAP_PRIVATE, fd_, map_offset_);
+
+    if (mem_ == MAP_FAILED)
+    {
+      mem_ = nullptr;
+      throw std::string("Unable to mmap input file");
+    }
 
+    madvise(mem_, map_length_, MADV_SEQUENTIAL);
+    if (window_ != 0)
+    {
+      madvise(mem_, map_length_, MADV_WILLNEED);
+    }
+  }
 
+  void unmap()
+  {
+    if (mem_ != nullptr)
+    {
+      munmap(mem_, map_length_);
+      mem_ = nullptr;
+    }
+  }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <vector>
+
+// The highest resident set size of the process so far, in bytes.
+inline size_t peak_rss()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  // Linux reports kilobytes
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+// The current resident set size in bytes, or zero if it can't be read.
+inline size_t current_rss()
+{
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t resident = 0;
+  if (!(statm >> pages >> resident))
+  {
+    return 0;
+  }
+
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+template <typename T>
+size_t vector_bytes(const std::vector<T>& v)
+{
+  return v.capacity() * sizeof(T);
+}
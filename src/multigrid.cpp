@@ -0,0 +1,394 @@
+#include "multigrid.h"
+#include "ratings.h"
+#include "step_sizes.h"
+#include "timer.h"
+
+#include <cmath>
+#include <numeric>
+
+// Aggregation multigrid for the Newton system of the log ratings. The
+// player graph is coarsened by grouping players with their most played
+// opponents, and a correction that is constant over each group is found by
+// solving the Galerkin coarse system P' H P d = P' e, where H is the
+// Hessian and e the errors. That fixes the smooth, long range part of the
+// error, such as a whole pool being offset, which the per player updates
+// take thousands of iterations to move.
+
+namespace
+{
+
+// an opponent is strongly connected if there are at least this fraction of
+// the games against the most played opponent
+constexpr double strength_threshold = 0.25;
+constexpr size_t max_aggregate = 16;
+
+constexpr size_t max_levels = 10;
+constexpr size_t coarsest_size = 200;
+
+constexpr int smoothing_sweeps = 2;
+constexpr int coarsest_sweeps = 100;
+constexpr int max_cycles = 20;
+
+void gauss_seidel(MultigridLevel& level, int sweeps)
+{
+  for (int s = 0; s != sweeps; ++s)
+  {
+    for (size_t i = 0; i != level.size(); ++i)
+    {
+      double diagonal = 0;
+      double sum = level.rhs[i];
+      for (auto j = level.indexes[i]; j != level.indexes[i+1]; ++j)
+      {
+        diagonal += level.weights[j];
+        sum += level.weights[j] * level.solution[level.opponents[j]];
+      }
+
+      if (diagonal > 0)
+      {
+        level.solution[i] = sum / diagonal;
+      }
+    }
+  }
+}
+
+void compute_residual(MultigridLevel& level)
+{
+  for (size_t i = 0; i != level.size(); ++i)
+  {
+    double product = 0;
+    for (auto j = level.indexes[i]; j != level.indexes[i+1]; ++j)
+    {
+      product += level.weights[j] * (level.solution[i] - level.solution[level.opponents[j]]);
+    }
+    level.residual[i] = level.rhs[i] - product;
+  }
+}
+
+}
+
+MultigridLevel coarsen(const std::vector<int64_t>& indexes,
+  const std::vector<int>& opponents, const std::vector<int>& played)
+{
+  MultigridLevel level;
+  auto n = indexes.size() - 1;
+  auto& aggregate = level.aggregate;
+  aggregate.assign(n, -1);
+  int count = 0;
+
+  auto threshold = [&](size_t i) {
+    int strongest = 0;
+    for (auto j = indexes[i]; j != indexes[i+1]; ++j)
+    {
+      strongest = std::max(strongest, played[j]);
+    }
+    return strength_threshold * strongest;
+  };
+
+  // seed an aggregate at each node whose strong neighbours are all free
+  for (size_t i = 0; i != n; ++i)
+  {
+    if (aggregate[i] != -1 || indexes[i] == indexes[i+1])
+    {
+      continue;
+    }
+
+    auto strong = threshold(i);
+    bool free = true;
+    for (auto j = indexes[i]; j != indexes[i+1] && free; ++j)
+    {
+      free = played[j] < strong || aggregate[opponents[j]] == -1;
+    }
+
+    if (!free)
+    {
+      continue;
+    }
+
+    aggregate[i] = count;
+    size_t size = 1;
+    for (auto j = indexes[i]; j != indexes[i+1] && size != max_aggregate; ++j)
+    {
+      if (played[j] >= strong && aggregate[opponents[j]] == -1)
+      {
+        aggregate[opponents[j]] = count;
+        ++size;
+      }
+    }
+    ++count;
+  }
+
+  // everything left joins its most played aggregated neighbour that has
+  // room, or starts a new aggregate if there isn't one
+  std::vector<size_t> sizes(count);
+  for (auto a : aggregate)
+  {
+    if (a != -1)
+    {
+      ++sizes[a];
+    }
+  }
+
+  for (size_t i = 0; i != n; ++i)
+  {
+    if (aggregate[i] != -1)
+    {
+      continue;
+    }
+
+    int best = -1;
+    int most = 0;
+    for (auto j = indexes[i]; j != indexes[i+1]; ++j)
+    {
+      auto a = aggregate[opponents[j]];
+      if (played[j] > most && a != -1 && sizes[a] < max_aggregate)
+      {
+        best = a;
+        most = played[j];
+      }
+    }
+
+    if (best == -1)
+    {
+      best = count++;
+      sizes.push_back(0);
+    }
+
+    aggregate[i] = best;
+    ++sizes[best];
+  }
+
+  level.member_indexes.assign(count + 1, 0);
+  for (auto a : aggregate)
+  {
+    ++level.member_indexes[a + 1];
+  }
+  std::partial_sum(level.member_indexes.begin(), level.member_indexes.end(),
+    level.member_indexes.begin());
+
+  level.members.resize(n);
+  {
+    std::vector<int> cursor(level.member_indexes.begin(), level.member_indexes.end() - 1);
+    for (size_t i = 0; i != n; ++i)
+    {
+      level.members[cursor[aggregate[i]]++] = i;
+    }
+  }
+
+  // the coarse edges of each aggregate, found by sorting the finer edges
+  // that leave it by the aggregate at the other end
+  level.edge_map.assign(opponents.size(), -1);
+  level.indexes.push_back(0);
+  std::vector<std::pair<int, int64_t>> edges;
+  for (int a = 0; a != count; ++a)
+  {
+    edges.clear();
+    for (auto m = level.member_indexes[a]; m != level.member_indexes[a+1]; ++m)
+    {
+      auto i = level.members[m];
+      for (auto j = indexes[i]; j != indexes[i+1]; ++j)
+      {
+        auto b = aggregate[opponents[j]];
+        if (b != a)
+        {
+          edges.emplace_back(b, j);
+        }
+      }
+    }
+
+    std::sort(edges.begin(), edges.end());
+    for (size_t e = 0; e != edges.size(); ++e)
+    {
+      auto [b, j] = edges[e];
+      if (e == 0 || b != edges[e-1].first)
+      {
+        level.opponents.push_back(b);
+        level.played.push_back(0);
+      }
+      level.played.back() += played[j];
+      level.edge_map[j] = level.opponents.size() - 1;
+    }
+
+    level.indexes.push_back(level.opponents.size());
+  }
+
+  level.weights.resize(level.opponents.size());
+  level.rhs.resize(count);
+  level.solution.resize(count);
+  level.residual.resize(count);
+
+  return level;
+}
+
+void multigrid_cycle(std::vector<MultigridLevel>& levels, size_t level)
+{
+  auto& current = levels[level];
+  std::fill(current.solution.begin(), current.solution.end(), 0);
+
+  if (level + 1 == levels.size())
+  {
+    gauss_seidel(current, coarsest_sweeps);
+    return;
+  }
+
+  gauss_seidel(current, smoothing_sweeps);
+  compute_residual(current);
+
+  auto& coarser = levels[level + 1];
+  std::fill(coarser.rhs.begin(), coarser.rhs.end(), 0);
+  for (size_t i = 0; i != current.size(); ++i)
+  {
+    coarser.rhs[coarser.aggregate[i]] += current.residual[i];
+  }
+
+  multigrid_cycle(levels, level + 1);
+
+  for (size_t i = 0; i != current.size(); ++i)
+  {
+    current.solution[i] += coarser.solution[coarser.aggregate[i]];
+  }
+
+  gauss_seidel(current, smoothing_sweeps);
+}
+
+void RatingsCalc::multigrid_setup()
+{
+  Timer timer;
+  timer.start();
+
+  levels_.clear();
+  levels_.push_back(coarsen(game_indexes_, opp_index_, opp_played_));
+  while (levels_.size() != max_levels && levels_.back().size() > coarsest_size)
+  {
+    const auto& finer = levels_.back();
+    auto next = coarsen(finer.indexes, finer.opponents, finer.played);
+
+    // stop once the graph hardly shrinks
+    if (next.size() * 5 > finer.size() * 4)
+    {
+      break;
+    }
+
+    levels_.push_back(std::move(next));
+  }
+
+  for (size_t k = 0; k != levels_.size(); ++k)
+  {
+    std::cout << "Multigrid level " << k + 1 << ": " << levels_[k].size()
+      << " players, " << levels_[k].opponents.size() << " pairings" << std::endl;
+  }
+
+  timer.stop("multigrid setup");
+}
+
+// Sets the first coarse level to the Galerkin operator of the current
+// Hessian and the restricted errors, and the deeper levels from that. Each
+// aggregate only writes its own edges, so the first level splits over the
+// pool.
+void RatingsCalc::multigrid_restrict()
+{
+  auto& first = levels_.front();
+  parallel_for(pool(), first.size(), [this, &first](size_t begin, size_t end) {
+    for (size_t a = begin; a != end; ++a)
+    {
+      std::fill(first.weights.begin() + first.indexes[a],
+        first.weights.begin() + first.indexes[a+1], 0);
+
+      double rhs = 0;
+      for (auto m = first.member_indexes[a]; m != first.member_indexes[a+1]; ++m)
+      {
+        auto p = first.members[m];
+        rhs += errors_[p];
+
+        auto rating = ratings_[p];
+        for (auto j = game_indexes_[p]; j != game_indexes_[p+1]; ++j)
+        {
+          auto edge = first.edge_map[j];
+          if (edge != -1)
+          {
+            auto opponent = ratings_[opp_index_[j]];
+            auto total = rating + opponent;
+            first.weights[edge] += opp_played_[j] * rating * opponent / (total * total);
+          }
+        }
+      }
+      first.rhs[a] = rhs;
+    }
+  }, 256);
+
+  for (size_t k = 1; k != levels_.size(); ++k)
+  {
+    auto& finer = levels_[k-1];
+    auto& coarser = levels_[k];
+    std::fill(coarser.weights.begin(), coarser.weights.end(), 0);
+    for (size_t j = 0; j != finer.weights.size(); ++j)
+    {
+      if (coarser.edge_map[j] != -1)
+      {
+        coarser.weights[coarser.edge_map[j]] += finer.weights[j];
+      }
+    }
+  }
+}
+
+// Cycles of a coarse correction followed by a few plain updates, until the
+// total error stops falling quickly. The solver then carries on from there.
+void RatingsCalc::multigrid_warm_start()
+{
+  multigrid_setup();
+
+  Timer timer;
+  timer.start();
+
+  // the ratings before the last correction, and their errors
+  std::vector<double> saved;
+  std::vector<double> saved_errors;
+  ErrorNorms saved_norms;
+  double previous = std::numeric_limits<double>::infinity();
+  int cycle;
+  for (cycle = 0; cycle != max_cycles; ++cycle)
+  {
+    double e = calculate_errors();
+    std::cout << "Multigrid cycle " << cycle << " total error = " << e << std::endl;
+
+    if (e > previous)
+    {
+      ratings_ = saved;
+      errors_ = saved_errors;
+      error_norms_ = saved_norms;
+      break;
+    }
+
+    if (converged() || e > 0.9 * previous)
+    {
+      break;
+    }
+
+    previous = e;
+    saved = ratings_;
+    saved_errors = errors_;
+    saved_norms = error_norms_;
+
+    multigrid_restrict();
+    multigrid_cycle(levels_, 0);
+
+    const auto& first = levels_.front();
+    parallel_ranges(pool(), work_ranges_, [this, &first](size_t begin, size_t end) {
+      for (size_t p = begin; p != end; ++p)
+      {
+        auto step = first.solution[first.aggregate[p]];
+        ratings_[p] *= std::exp(std::clamp(step, -max_log_step, max_log_step));
+      }
+    });
+
+    for (int s = 0; s != smoothing_sweeps; ++s)
+    {
+      calculate_errors();
+      adjust_waiter_.run_and_wait(pool());
+    }
+  }
+
+  std::cout << cycle << " multigrid cycles" << std::endl;
+  timer.stop("multigrid warm start");
+
+  levels_ = std::vector<MultigridLevel>();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One coarse level of the player graph. Each node is an aggregate of nodes
+// on the finer level, and its edges are the finer edges between different
+// aggregates, with the games summed.
+struct MultigridLevel
+{
+  // the node on this level that each finer node belongs to
+  std::vector<int> aggregate;
+  // the edge on this level that each finer edge adds to, or -1 for edges
+  // inside an aggregate
+  std::vector<int64_t> edge_map;
+
+  // the finer nodes in each aggregate
+  std::vector<int> member_indexes;
+  std::vector<int> members;
+
+  // the graph in the same layout as the fine opponent arrays
+  std::vector<int64_t> indexes;
+  std::vector<int> opponents;
+  std::vector<int> played;
+
+  // the Galerkin operator of the current Hessian, and the linear solve
+  std::vector<double> weights;
+  std::vector<double> rhs;
+  std::vector<double> solution;
+  std::vector<double> residual;
+
+  size_t size() const
+  {
+    return indexes.size() - 1;
+  }
+};
+
+// Aggregates a graph, given as CSR arrays of opponents and games played,
+// into the next coarser level.
+MultigridLevel coarsen(const std::vector<int64_t>& indexes,
+  const std::vector<int>& opponents, const std::vector<int>& played);
+
+// Approximately solves the weighted Laplacian system on levels[level] with
+// a V-cycle over the coarser levels. The weights and rhs must be set, and
+// the result is left in solution.
+void multigrid_cycle(std::vector<MultigridLevel>& levels, size_t level);
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <absl/container/flat_hash_set.h>
+#include <absl/hash/hash.h>
+
+// Player names stored one after the other in a single arena, numbered in
+// the order they were added. The names are copied in, so they don't depend
+// on the input still being mapped, and looking up a name by id is just an
+// index into the offsets.
+class NameInterner
+{
+  public:
+  NameInterner()
+  : index_(0, Hash{this}, Eq{this})
+  {
+  }
+
+  // the index refers back to this object
+  NameInterner(const NameInterner&) = delete;
+  NameInterner& operator=(const NameInterner&) = delete;
+
+  // The id of name, adding it if it hasn't been seen before.
+  int intern(std::string_view name)
+  {
+    catch_up();
+
+    auto found = index_.find(name);
+    if (found != index_.end())
+    {
+      return *found;
+    }
+
+    auto id = append(name);
+    index_.insert(static_cast<uint32_t>(id));
+    indexed_ = offsets_.size() - 1;
+
+    return id;
+  }
+
+  // Adds a name that is known not to be here already, without hashing it.
+  // It is added to the index the next time intern is called.
+  int append(std::string_view name)
+  {
+    arena_.insert(arena_.end(), name.begin(), name.end());
+    offsets_.push_back(arena_.size());
+
+    return offsets_.size() - 2;
+  }
+
+  std::string_view name(size_t id) const
+  {
+    return std::string_view(arena_.data() + offsets_[id], offsets_[id + 1] - offsets_[id]);
+  }
+
+  size_t size() const
+  {
+    return offsets_.size() - 1;
+  }
+
+  void reserve(size_t names, size_t bytes)
+  {
+    offsets_.reserve(names + 1);
+    arena_.reserve(bytes);
+  }
+
+  // Frees the hash index once no more names will be looked up. Ids can
+  // still be turned into names, but intern can't be called again.
+  void release_index()
+  {
+    index_ = decltype(index_)(0, Hash{this}, Eq{this});
+    indexed_ = size();
+  }
+
+  size_t arena_bytes() const
+  {
+    return arena_.capacity();
+  }
+
+  size_t offsets_bytes() const
+  {
+    return offsets_.capacity() * sizeof(uint64_t);
+  }
+
+  size_t index_bytes() const
+  {
+    // a slot and a control byte for each entry
+    return index_.capacity() * (sizeof(uint32_t) + 1);
+  }
+
+  private:
+  // The index holds ids, and hashes and compares them by their names, so
+  // that a lookup by string_view doesn't need a second copy of each name.
+  struct Hash
+  {
+    using is_transparent = void;
+
+    const NameInterner* names;
+
+    size_t operator()(std::string_view name) const
+    {
+      return absl::Hash<std::string_view>{}(name);
+    }
+
+    size_t operator()(uint32_t id) const
+    {
+      return (*this)(names->name(id));
+    }
+  };
+
+  struct Eq
+  {
+    using is_transparent = void;
+
+    const NameInterner* names;
+
+    std::string_view view(std::string_view name) const
+    {
+      return name;
+    }
+
+    std::string_view view(uint32_t id) const
+    {
+      return names->name(id);
+    }
+
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const
+    {
+      return view(a) == view(b);
+    }
+  };
+
+  std::vector<char> arena_;
+  std::vector<uint64_t> offsets_ = {0};
+  absl::flat_hash_set<uint32_t, Hash, Eq> index_;
+  size_t indexed_ = 0;
+
+  void catch_up()
+  {
+    for (; indexed_ != size(); ++indexed_)
+    {
+      index_.insert(indexed_);
+    }
+  }
+};
@@ -0,0 +1,189 @@
+#include "ratings.h"
+#include "step_sizes.h"
+#include "timer.h"
+
+#include <cmath>
+
+// Newton's method on the log ratings t = ln(r). The gradient of the log
+// likelihood is the error W - sum(n_j * p_j), where p_j = r / (r + r_j), so
+// it comes straight out of calculate_errors. The Hessian is the weighted
+// graph Laplacian with weights n_j * p_j * (1 - p_j), which is never stored:
+// each product recomputes the weights from the ratings while walking the
+// same opponent arrays as the error kernel.
+
+namespace
+{
+
+constexpr int max_iterations = 1000;
+constexpr int max_cg_iterations = 200;
+
+struct ResidualSums
+{
+  double rr = 0;
+  double rz = 0;
+
+  ResidualSums& operator+=(const ResidualSums& other)
+  {
+    rr += other.rr;
+    rz += other.rz;
+    return *this;
+  }
+};
+
+}
+
+int RatingsCalc::solve_newton()
+{
+  Timer timer;
+  std::vector<double> diagonal(ratings_.size());
+  std::vector<double> step(ratings_.size());
+
+  int i;
+  int cg_total = 0;
+  for (i = 0; i != max_iterations && !out_of_budget(i); ++i)
+  {
+    timer.start();
+    double e = calculate_errors();
+    std::cout << "Total error = " << e << std::endl;
+
+    if (converged())
+    {
+      break;
+    }
+
+    newton_diagonal(diagonal);
+    auto cg_iterations = conjugate_gradient(diagonal, step);
+    cg_total += cg_iterations;
+
+    parallel_ranges(pool(), work_ranges_, [this, &step](size_t begin, size_t end) {
+      for (size_t p = begin; p != end; ++p)
+      {
+        ratings_[p] *= std::exp(std::clamp(step[p], -max_log_step, max_log_step));
+      }
+    });
+
+    std::cout << cg_iterations << " CG iterations" << std::endl;
+    timer.stop("newton step");
+  }
+
+  std::cout << cg_total << " CG iterations in total" << std::endl;
+
+  return i;
+}
+
+void RatingsCalc::newton_diagonal(std::vector<double>& diagonal)
+{
+  parallel_ranges(pool(), work_ranges_, [this, &diagonal](size_t begin, size_t end) {
+    for (size_t p = begin; p != end; ++p)
+    {
+      auto rating = ratings_[p];
+      double sum = 0;
+      for (auto j = game_indexes_[p]; j != game_indexes_[p+1]; ++j)
+      {
+        auto opponent = ratings_[opp_index_[j]];
+        auto total = rating + opponent;
+        sum += opp_played_[j] * rating * opponent / (total * total);
+      }
+      diagonal[p] = sum;
+    }
+  });
+}
+
+// Sets result to H v and returns v . H v.
+double RatingsCalc::hessian_product(const std::vector<double>& v, std::vector<double>& result)
+{
+  return parallel_sum(pool(), work_ranges_, [&](size_t begin, size_t end) {
+    double dot = 0;
+    for (size_t p = begin; p != end; ++p)
+    {
+      auto rating = ratings_[p];
+      auto vp = v[p];
+      double sum = 0;
+      for (auto j = game_indexes_[p]; j != game_indexes_[p+1]; ++j)
+      {
+        auto o = opp_index_[j];
+        auto opponent = ratings_[o];
+        auto total = rating + opponent;
+        sum += opp_played_[j] * rating * opponent / (total * total) * (vp - v[o]);
+      }
+      result[p] = sum;
+      dot += vp * sum;
+    }
+    return dot;
+  });
+}
+
+// Solves H x = errors_ with Jacobi preconditioned CG, starting from zero.
+// The tolerance loosens when the error is large, since an exact Newton
+// step is wasted far from the solution.
+int RatingsCalc::conjugate_gradient(const std::vector<double>& diagonal, std::vector<double>& x)
+{
+  auto n = ratings_.size();
+  std::vector<double> residual(errors_);
+  std::vector<double> z(n);
+  std::vector<double> direction(n);
+  std::vector<double> product(n);
+
+  auto precondition = [&](size_t p) {
+    return diagonal[p] > 0 ? residual[p] / diagonal[p] : 0.0;
+  };
+
+  auto initial = parallel_sum(pool(), work_ranges_, [&](size_t begin, size_t end) {
+    ResidualSums sums;
+    for (size_t p = begin; p != end; ++p)
+    {
+      x[p] = 0;
+      z[p] = precondition(p);
+      direction[p] = z[p];
+      sums.rr += residual[p] * residual[p];
+      sums.rz += residual[p] * z[p];
+    }
+    return sums;
+  });
+
+  double rr = initial.rr;
+  double rz = initial.rz;
+
+  double forcing = std::clamp(std::sqrt(std::sqrt(rr)), 1e-4, 0.5);
+  double tolerance = forcing * forcing * rr;
+
+  int k;
+  for (k = 0; k != max_cg_iterations && rr > tolerance && rz > 0; ++k)
+  {
+    double curvature = hessian_product(direction, product);
+    if (curvature <= 0)
+    {
+      break;
+    }
+
+    double alpha = rz / curvature;
+
+    // update the solution and residual, and gather both dot products for
+    // the next direction in the same pass
+    auto sums = parallel_sum(pool(), work_ranges_, [&](size_t begin, size_t end) {
+      ResidualSums sums;
+      for (size_t p = begin; p != end; ++p)
+      {
+        x[p] += alpha * direction[p];
+        residual[p] -= alpha * product[p];
+        z[p] = precondition(p);
+        sums.rr += residual[p] * residual[p];
+        sums.rz += residual[p] * z[p];
+      }
+      return sums;
+    });
+
+    double beta = sums.rz / rz;
+    rr = sums.rr;
+    rz = sums.rz;
+
+    parallel_ranges(pool(), work_ranges_, [&](size_t begin, size_t end) {
+      for (size_t p = begin; p != end; ++p)
+      {
+        direction[p] = z[p] + beta * direction[p];
+      }
+    });
+  }
+
+  return k;
+}
@@ -0,0 +1,144 @@
+#include "pgn.h"
+#include "game_chunk.h"
+
+#include <cstring>
+#include <string_view>
+
+namespace
+{
+
+using std::operator""sv;
+
+std::string_view tag_value(std::string_view line)
+{
+  auto first = line.find('"');
+  auto last = line.rfind('"');
+  if (first == std::string_view::npos || last == first)
+  {
+    return {};
+  }
+
+  return line.substr(first + 1, last - first - 1);
+}
+
+char outcome(std::string_view result)
+{
+  if (result == "1-0"sv)
+  {
+    return 'w';
+  }
+  else if (result == "0-1"sv)
+  {
+    return 'b';
+  }
+  else if (result == "1/2-1/2"sv)
+  {
+    return 'd';
+  }
+
+  return 0;
+}
+
+}
+
+void parse_pgn(const char* begin, const char* end, GameChunk& chunk)
+{
+  std::string_view white;
+  std::string_view black;
+  char result = 0;
+  bool in_tags = false;
+
+  // A tag can only follow another tag or a blank line; anything else that
+  // starts with '[' is a wrapped movetext comment.
+  bool tag_allowed = true;
+
+  auto finish_game = [&]()
+  {
+    if (in_tags && result != 0 && !white.empty() && !black.empty())
+    {
+      chunk.add_game(white, black, result);
+    }
+
+    white = {};
+    black = {};
+    result = 0;
+    in_tags = false;
+  };
+
+  const char* p = begin;
+  while (p < end)
+  {
+    auto* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    const char* line_end = newline == nullptr ? end : newline;
+    std::string_view line(p, line_end);
+    p = line_end + 1;
+
+    if (!line.empty() && line.back() == '\r')
+    {
+      line.remove_suffix(1);
+    }
+
+    if (tag_allowed && line.starts_with('['))
+    {
+      in_tags = true;
+      if (line.starts_with("[White "sv))
+      {
+        white = tag_value(line);
+      }
+      else if (line.starts_with("[Black "sv))
+      {
+        black = tag_value(line);
+      }
+      else if (line.starts_with("[Result "sv))
+      {
+        result = outcome(tag_value(line));
+      }
+      continue;
+    }
+
+    finish_game();
+    tag_allowed = line.empty();
+  }
+
+  finish_game();
+}
+
+const char* next_pgn_game(const char* p, const char* end)
+{
+  // a tag section starts at a '[' following a blank line
+  while (p < end)
+  {
+    auto* found = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (found == nullptr || end - found < 3)
+    {
+      return end;
+    }
+
+    if (found[1] == '\n' && found[2] == '[')
+    {
+      return found + 2;
+    }
+    else if (found[1] == '\r' && end - found >= 4 && found[2] == '\n' && found[3] == '[')
+    {
+      return found + 3;
+    }
+
+    p = found + 1;
+  }
+
+  return end;
+}
+
+const char* last_pgn_game(const char* begin, const char* end)
+{
+  for (const char* p = end - 1; p - begin >= 2; --p)
+  {
+    if (*p == '[' && p[-1] == '\n' &&
+      (p[-2] == '\n' || (p[-2] == '\r' && p - begin >= 3 && p[-3] == '\n')))
+    {
+      return p;
+    }
+  }
+
+  return begin;
+}
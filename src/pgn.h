@@ -0,0 +1,16 @@
+#pragma once
+
+class GameChunk;
+
+// Reads the White, Black and Result tags of every game in [begin, end) into
+// chunk. Movetext is skipped a line at a time, and games without a decided
+// result are dropped.
+void parse_pgn(const char* begin, const char* end, GameChunk& chunk);
+
+// The start of the first game at or after p, for splitting a PGN file into
+// chunks that can be parsed independently.
+const char* next_pgn_game(const char* p, const char* end);
+
+// The start of the last game that begins in [begin, end), or begin if there
+// isn't one. Used to find the partial game at the end of a stream buffer.
+const char* last_pgn_game(const char* begin, const char* end);
@@ -0,0 +1,129 @@
+#include "ratings.h"
+#include "rating_updates.h"
+#include "step_sizes.h"
+#include "timer.h"
+
+#include <cmath>
+#include <queue>
+
+// Residual driven updates, in the style of PageRank push. The errors are
+// kept up to date incrementally: when a player's rating changes, the change
+// in expected score against each opponent is pushed onto that opponent's
+// error, and the opponent is queued if its error is now large enough. Work
+// goes where the ratings are still moving, instead of every player on
+// every iteration. Players are taken in rounds, each with half the
+// threshold of the one before, so the largest errors are dealt with first.
+
+namespace
+{
+
+// the first threshold on |error| / played, which halves each time the queue
+// drains without the total error meeting the tolerance
+constexpr double first_threshold = 0.1;
+
+// The smallest threshold. Below it the queue would be chasing the rounding
+// in the incremental errors, and might never drain, so the rounds repeat at
+// this threshold until the budget runs out.
+constexpr double min_threshold = 1e-12;
+
+// updates between checks of the time limit, since one round can be long
+constexpr size_t budget_interval = 4096;
+
+}
+
+int RatingsCalc::solve_push()
+{
+  Timer timer;
+  timer.start();
+
+  auto players = ratings_.size();
+
+  // The thresholds do the prioritising: a queue ordered by error did the
+  // same number of updates as first in first out, at twice the time.
+  std::queue<int> queue;
+  std::vector<char> queued(players);
+
+  auto normalised = [this](int p) {
+    return std::fabs(errors_[p]) / played_[p];
+  };
+
+  auto push = [&](int p, double threshold) {
+    if (!queued[p] && played_[p] != 0 && normalised(p) > threshold)
+    {
+      queued[p] = true;
+      queue.push(p);
+    }
+  };
+
+  size_t updates = 0;
+  size_t edges = 0;
+  double threshold = first_threshold;
+  int round;
+  for (round = 0; ; ++round)
+  {
+    // a full pass to start each round, which also clears the rounding that
+    // builds up in the incremental errors, and leaves exact errors when the
+    // budget runs out
+    double e = calculate_errors();
+    edges += opp_index_.size();
+    std::cout << "Total error = " << e << ", threshold " << threshold << ", "
+      << updates << " updates" << std::endl;
+
+    if (converged() || out_of_budget(round))
+    {
+      break;
+    }
+
+    for (size_t p = 0; p != players; ++p)
+    {
+      push(p, threshold);
+    }
+
+    while (!queue.empty())
+    {
+      auto p = queue.front();
+      queue.pop();
+      queued[p] = false;
+
+      if (normalised(p) <= threshold)
+      {
+        continue;
+      }
+
+      auto old_rating = ratings_[p];
+      auto rating = updated_rating(p, old_rating, errors_[p], kstep_k);
+      ratings_[p] = rating;
+
+      // the opponents' expected scores move the other way to this player's
+      double expected = 0;
+      for (auto j = game_indexes_[p]; j != game_indexes_[p+1]; ++j)
+      {
+        auto o = opp_index_[j];
+        auto opponent = ratings_[o];
+        auto now = expected_score(rating, opp_played_[j], opponent);
+        auto before = expected_score(old_rating, opp_played_[j], opponent);
+        expected += now;
+        errors_[o] += now - before;
+        push(o, threshold);
+      }
+      errors_[p] = scores_[p] - expected;
+      push(p, threshold);
+
+      ++updates;
+      edges += game_indexes_[p+1] - game_indexes_[p];
+
+      if (updates % budget_interval == 0 && out_of_budget(round))
+      {
+        break;
+      }
+    }
+
+    threshold = std::max(threshold / 2, min_threshold);
+  }
+
+  std::cout << updates << " player updates, " << edges << " edges visited, the same as "
+    << static_cast<double>(edges) / opp_index_.size() << " full sweeps" << std::endl;
+  timer.stop("push updates");
+
+  return round;
+}
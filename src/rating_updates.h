@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "step_sizes.h"
+
+// The update of one player's rating from their error, which the update
+// kernels and the solvers that go one player at a time all use. Like the
+// kernels, they're in an anonymous namespace, so the copies built for each
+// instruction set stay apart.
+
+namespace
+{
+
+// The expected score n * r / (r + r_j) against one opponent played n
+// times.
+inline double expected_score(double rating, int games, double opponent)
+{
+  return games * rating / (rating + opponent);
+}
+
+// kstep, r * 10^(K e / played)
+inline double kstep_rating(double rating, double error, int played, double K)
+{
+  return rating * std::pow(10.0, K * (error / played));
+}
+
+// The largest fall in a log rating in one MM update, max_log_step scaled by
+// the share of the games the player is expected to win. A player with no
+// points has W = 0, and would go to zero in one step. With the floor, they
+// shrink like a kstep update instead, more slowly as their expected score
+// vanishes, and never underflow.
+inline double mm_log_floor(double expected, int played)
+{
+  return -max_log_step * expected / played;
+}
+
+// The MM update is r' = W / sum(n_j / (r + r_j)). The error pass already
+// gathers sum(n_j * r / (r + r_j)), which is the expected score W - e, so
+// the update is r * W / (W - e).
+inline double mm_rating(double rating, double score, double error, int played)
+{
+  double expected = score - error;
+  if (expected <= 0)
+  {
+    return rating;
+  }
+
+  // e^floor <= 1 / (1 - floor), so the exp is only needed for players
+  // whose ratio is below that
+  double ratio = score / expected;
+  double floor = mm_log_floor(expected, played);
+  if (ratio * (1 - floor) < 1)
+  {
+    ratio = std::max(ratio, std::exp(floor));
+  }
+
+  return rating * ratio;
+}
+
+// The same updates on natural log ratings, where kstep needs no pow.
+inline double kstep_log_rating(double rating, double error, int played, double K)
+{
+  return rating + K * std::numbers::ln10 * error / played;
+}
+
+inline double mm_log_rating(double rating, double score, double error, int played)
+{
+  double expected = score - error;
+  if (expected <= 0)
+  {
+    return rating;
+  }
+
+  return rating + std::max(std::log(score / expected), mm_log_floor(expected, played));
+}
+
+}
@@ -1,15 +1,39 @@
+#include "binary_games.h"
+#include "decompress.h"
 #include "mapped_file.h"
+#include "memory.h"
+#include "pgn.h"
 #include "ratings.h"
+#include "rating_updates.h"
+#include "step_sizes.h"
+#include "scanner.h"
+#include "stream_reader.h"
 #include "timer.h"
 
+#include "threads/parallel.h"
 #include "threads/threads.h"
 
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <ranges>
+#include <thread>
 
 namespace
 {
 
+const char* next_line(const char* p, const char* end)
+{
+  auto* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+  return newline == nullptr ? end : newline + 1;
+}
+
+const char* last_line(const char* begin, const char* end)
+{
+  auto* newline = static_cast<const char*>(memrchr(begin, '\n', end - begin));
+  return newline == nullptr ? begin : newline + 1;
+}
+
 double next_k(double previous, double error, int iteration)
 {
   if (error < 1)
@@ -22,30 +46,341 @@ double next_k(double previous, double error, int iteration)
     return 33;
   }
 
-  return 1.6;
+  return kstep_k;
+}
+
+// pools up to this size are solved by dense Newton on one thread
+constexpr size_t max_dense_players = 200;
+
+// iterations between full error passes in the active set mode
+constexpr int active_interval = 10;
+
+// the fraction of the total error the frozen players may carry
+constexpr double active_fraction = 0.01;
+
+// the error per game the float phase of --float-ratings stops at
+constexpr double float_tolerance = 1e-6;
+
+// Float ratings are capped here so that a rating plus an opponent's can't
+// overflow. Players who win every game head there under kstep.
+constexpr float max_float_rating = 1e30f;
+
+}
+
+Solver solver_from_name(const std::string& name)
+{
+  if (name == "adaptive")
+  {
+    return Solver::Adaptive;
+  }
+  else if (name == "kstep")
+  {
+    return Solver::KStep;
+  }
+  else if (name == "mm")
+  {
+    return Solver::MM;
+  }
+  else if (name == "newton")
+  {
+    return Solver::Newton;
+  }
+
+  throw "Unknown solver " + name;
 }
 
+const char* solver_name(Solver solver)
+{
+  switch (solver)
+  {
+    case Solver::Adaptive:
+    return "adaptive";
+    case Solver::KStep:
+    return "kstep";
+    case Solver::MM:
+    return "mm";
+    case Solver::Newton:
+    return "newton";
+  }
+
+  return "unknown";
+}
+
+void RatingsCalc::benchmark_kernels()
+{
+  constexpr int passes = 20;
+
+  // the largest difference in |error| / played from the double scalar
+  // kernel, with float_tolerance for the float kernels
+  constexpr double tolerance = 1e-9;
+
+  // spread the ratings out so that rounding differences show
+  for (size_t p = 0; p != ratings_.size(); ++p)
+  {
+    ratings_[p] = std::exp(std::sin(static_cast<double>(p)));
+  }
+
+  auto chosen = kernels_;
+  auto chosen_unroll = options_.unroll;
+  std::vector<double> scalar_errors;
+
+  float_ratings_.resize(ratings_.size());
+  store_float_ratings();
+
+  // double, float, and double log ratings
+  for (int mode = 0; mode != 3; ++mode)
+  {
+    bool use_float = mode == 1;
+    bool log_domain = mode == 2;
+    use_float_ = use_float;
+    if (log_domain != log_domain_)
+    {
+      for (auto& rating : ratings_)
+      {
+        rating = std::log(rating);
+      }
+      log_domain_ = true;
+    }
+
+    for (auto isa : {Isa::Scalar, Isa::Avx2, Isa::Avx512})
+    {
+      if (!isa_supported(isa))
+      {
+        continue;
+      }
+      kernels_ = &kernels_for(isa);
+
+      for (int unroll : {1, 2, 4})
+      {
+        options_.unroll = unroll;
+        select_error_kernel();
+
+        Timer timer;
+        timer.start();
+        for (int i = 0; i != passes; ++i)
+        {
+          calculate_errors(0, ratings_.size());
+        }
+        auto seconds = std::chrono::duration<double>(timer.stop()).count();
+        double edges = static_cast<double>(opp_index_.size()) * passes;
+
+        if (scalar_errors.empty())
+        {
+          scalar_errors = errors_;
+        }
+
+        double difference = 0;
+        for (size_t p = 0; p != errors_.size(); ++p)
+        {
+          if (played_[p] != 0)
+          {
+            difference = std::max(difference, std::fabs(errors_[p] - scalar_errors[p]) / played_[p]);
+          }
+        }
+
+        std::string name = std::string(isa_name(isa)) + (use_float ? " float" : "")
+          + (log_domain ? " log" : "") + " unroll " + std::to_string(unroll);
+        std::cout << name << ": " << edges / seconds / 1e6
+          << " million edges per second per core, max difference from scalar "
+          << difference << " per game" << std::endl;
+
+        if (difference > (use_float ? float_tolerance : tolerance))
+        {
+          throw "Error kernel " + name + " differs from scalar";
+        }
+      }
+    }
+  }
+
+  use_float_ = false;
+  log_domain_ = false;
+  kernels_ = chosen;
+  options_.unroll = chosen_unroll;
+  select_error_kernel();
+  std::fill(ratings_.begin(), ratings_.end(), 1);
 }
 
 void RatingsCalc::find_ratings()
+{
+  solve_start_ = std::chrono::steady_clock::now();
+  select_error_kernel();
+
+  // Dense stands in for the default adaptive solver, but not for a solver
+  // or mode that was asked for, which run on this thread instead. The
+  // anderson, async, push and active set modes need kstep or mm.
+  bool dense = small_ && options_.solver == Solver::Adaptive && !options_.multigrid
+    && !options_.float_ratings && !options_.log_ratings;
+  if (dense)
+  {
+    auto iterations = solve_dense();
+    std::cout << "Done ratings in " << iterations << " iterations with the dense solver" << std::endl;
+    report_convergence();
+    return;
+  }
+
+  if (options_.multigrid)
+  {
+    multigrid_warm_start();
+  }
+
+  if (options_.log_ratings)
+  {
+    parallel_ranges(pool(), work_ranges_, [this](size_t begin, size_t end) {
+      for (size_t p = begin; p != end; ++p)
+      {
+        ratings_[p] = std::log(ratings_[p]);
+      }
+    });
+    log_domain_ = true;
+    select_error_kernel();
+  }
+
+  int iterations = 0;
+  auto policy = options_.convergence;
+  if (options_.float_ratings)
+  {
+    // Float rounding leaves errors of around 1e-7 per game, so the float
+    // phase can't meet a tighter tolerance. It stops at float_tolerance, and
+    // the double phase takes it the rest of the way.
+    auto& loose = options_.convergence;
+    if (loose.total > 0)
+    {
+      loose.total = std::max(loose.total, float_tolerance * games_);
+    }
+    loose.mean_per_game = loose.mean_per_game > 0 ? std::max(loose.mean_per_game, float_tolerance) : 0;
+    loose.max_per_player = loose.max_per_player > 0 ? std::max(loose.max_per_player, float_tolerance) : 0;
+
+    use_float_ = true;
+    float_ratings_.resize(ratings_.size());
+    select_error_kernel();
+    iterations = solve();
+    use_float_ = false;
+    select_error_kernel();
+
+    std::cout << "Float phase done in " << iterations << " iterations, total error "
+      << error_norms_.total << std::endl;
+
+    // the iteration limit covers both phases
+    options_.convergence = policy;
+    options_.convergence.max_iterations -= iterations;
+  }
+
+  iterations += solve();
+  options_.convergence = policy;
+
+  if (log_domain_)
+  {
+    parallel_ranges(pool(), work_ranges_, [this](size_t begin, size_t end) {
+      for (size_t p = begin; p != end; ++p)
+      {
+        ratings_[p] = std::exp(ratings_[p]);
+      }
+    });
+    log_domain_ = false;
+    select_error_kernel();
+  }
+
+  std::cout << "Done ratings in " << iterations << " iterations with the "
+    << solver_name(options_.solver) << " solver" << std::endl;
+  report_convergence();
+
+  std::cout << "Job times" << std::endl;
+  std::ranges::for_each(job_times_, [](auto t) {
+    std::cout << t << std::endl;
+  });
+
+  report_memory("solve");
+}
+
+int RatingsCalc::solve()
+{
+  int iterations = 0;
+  switch (options_.solver)
+  {
+    case Solver::Adaptive:
+    iterations = solve_adaptive();
+    break;
+
+    case Solver::KStep:
+    case Solver::MM:
+    if (options_.anderson > 0)
+    {
+      iterations = solve_anderson();
+    }
+    else if (options_.async)
+    {
+      iterations = solve_async();
+    }
+    else if (options_.push)
+    {
+      iterations = solve_push();
+    }
+    else if (options_.active_set)
+    {
+      iterations = solve_active_set();
+    }
+    else
+    {
+      iterations = solve_fixed_point();
+    }
+    break;
+
+    case Solver::Newton:
+    iterations = solve_newton();
+    break;
+  }
+
+  return iterations;
+}
+
+void RatingsCalc::report_convergence()
+{
+  std::cout << "Total error " << error_norms_.total << ", mean per game "
+    << error_norms_.total / std::max<int64_t>(games_, 1);
+  // only tracked when the policy limits it
+  if (error_config_.max_per_player)
+  {
+    std::cout << ", max per player " << error_norms_.max_per_player;
+  }
+  std::cout << std::endl;
+
+  if (converged())
+  {
+    return;
+  }
+
+  if (stalled_)
+  {
+    std::cout << "Stopped before converging, no step lowers the error any further" << std::endl;
+  }
+  else
+  {
+    std::cout << "Stopped at the iteration or time limit before converging" << std::endl;
+  }
+}
+
+int RatingsCalc::solve_fixed_point()
 {
   Timer timer;
   int i;
-  for (i = 0; i != 100000; ++i)
+  for (i = 0; !out_of_budget(i); ++i)
   {
     timer.start();
     double e = calculate_errors();
     if (i %50 == 0)
     {
       timer.stop("calculate_errors");
-      std::cout << "K = " << adjust_state_.K << std::endl;
+      if (options_.solver == Solver::KStep)
+      {
+        std::cout << "K = " << adjust_state_.K << std::endl;
+      }
     }
     if (i % 100 == 0)
     {
       std::cout << "Total error = " << e << std::endl;
     }
 
-    if (e < 0.5)
+    if (converged())
     {
       break;
     }
@@ -55,75 +390,287 @@ void RatingsCalc::find_ratings()
     //timer.stop("adjust_ratings");
   }
 
-  std::cout << "Done ratings in " << i << " iterations" << std::endl;
-
-  std::cout << "Job times" << std::endl;
-  std::ranges::for_each(job_times_, [](auto t) {
-    std::cout << t << std::endl;
-  });
+  return i;
 }
 
 void RatingsCalc::adjust_ratings_driver(int i, double e)
 {
   adjust_state_.iteration = i;
   adjust_state_.K = next_k(adjust_state_.K, e, i);
-  adjust_waiter_.run_and_wait(threads_);
+  adjust_waiter_.run_and_wait(pool());
+}
+
+// The fixed point iteration over only the players that are still moving.
+// Every few iterations a full error pass picks the players with the largest
+// errors, and only those are updated until the next full pass. Their
+// opponents' errors are the only other ones that change, so the error pass
+// covers those too, and the total stays exact. A full pass confirms
+// convergence at the end.
+int RatingsCalc::solve_active_set()
+{
+  Timer timer;
+  size_t active_sum = 0;
+  size_t error_sum = 0;
+  int full_passes = 0;
+  bool confirm = false;
+
+  int i;
+  for (i = 0; !out_of_budget(i); ++i)
+  {
+    timer.start();
+    bool full = confirm || i % active_interval == 0;
+    double e;
+    if (full)
+    {
+      e = calculate_errors();
+      compact_active_set(e);
+      ++full_passes;
+    }
+    else
+    {
+      auto ranges = block_ranges(pool(), active_errors_.size());
+      auto norms = parallel_sum(pool(), ranges, [this](size_t begin, size_t end) {
+        auto graph = kernel_graph();
+        ErrorNorms norms;
+        for (size_t k = begin; k != end; ++k)
+        {
+          auto p = active_errors_[k];
+          norms += player_error_kernel_(graph, errors_.data(), p, p + 1);
+        }
+        return norms;
+      });
+
+      error_norms_ = frozen_norms_;
+      error_norms_ += norms;
+      e = error_norms_.total;
+    }
+
+    if (i % 50 == 0)
+    {
+      timer.stop("calculate_errors");
+    }
+    if (full)
+    {
+      std::cout << "Active players = " << active_.size() << ", errors for "
+        << active_errors_.size() << std::endl;
+    }
+    if (i % 100 == 0)
+    {
+      std::cout << "Total error = " << e << std::endl;
+    }
+
+    if (converged())
+    {
+      if (full)
+      {
+        break;
+      }
+
+      confirm = true;
+      continue;
+    }
+    confirm = false;
+
+    adjust_state_.iteration = i;
+    adjust_state_.K = next_k(adjust_state_.K, e, i);
+    auto K = adjust_state_.K;
+    parallel_for(pool(), active_.size(), [this, K](size_t begin, size_t end) {
+      for (size_t k = begin; k != end; ++k)
+      {
+        auto p = active_[k];
+        ratings_[p] = updated_rating(p, ratings_[p], errors_[p], K);
+      }
+    });
+
+    active_sum += active_.size();
+    error_sum += full ? ratings_.size() : active_errors_.size();
+  }
+
+  auto iterations = std::max(i, 1);
+  std::cout << "Average active players " << active_sum / iterations << ", errors for "
+    << error_sum / iterations << " of " << ratings_.size() << ", "
+    << full_passes << " full passes" << std::endl;
+
+  active_ = std::vector<int>();
+  active_errors_ = std::vector<int>();
+
+  return i;
+}
+
+// Freezes the players with the smallest errors per game, up to a small
+// fraction of the total error, which tends to be most of the players, since
+// the error is concentrated in a few of them.
+void RatingsCalc::compact_active_set(double total_error)
+{
+  std::vector<std::pair<double, double>> normalised;
+  for (size_t p = 0; p != ratings_.size(); ++p)
+  {
+    if (played_[p] != 0)
+    {
+      auto e = std::fabs(errors_[p]);
+      normalised.emplace_back(e / played_[p], e);
+    }
+  }
+  std::sort(normalised.begin(), normalised.end());
+
+  double threshold = 0;
+  double frozen = 0;
+  for (auto [n, e] : normalised)
+  {
+    frozen += e;
+    if (frozen > active_fraction * total_error)
+    {
+      break;
+    }
+    threshold = n;
+  }
+
+  std::vector<char> active(ratings_.size());
+  active_.clear();
+  for (size_t p = 0; p != ratings_.size(); ++p)
+  {
+    if (played_[p] != 0 && std::fabs(errors_[p]) > threshold * played_[p])
+    {
+      active_.push_back(p);
+      active[p] = true;
+      for (auto j = game_indexes_[p]; j != game_indexes_[p+1]; ++j)
+      {
+        active[opp_index_[j]] = true;
+      }
+    }
+  }
+
+  active_errors_.clear();
+  frozen_norms_ = {};
+  for (size_t p = 0; p != ratings_.size(); ++p)
+  {
+    if (active[p])
+    {
+      active_errors_.push_back(p);
+    }
+    else
+    {
+      auto error = std::fabs(errors_[p]);
+      frozen_norms_.total += error;
+      if (played_[p] != 0)
+      {
+        frozen_norms_.max_per_player = std::max(frozen_norms_.max_per_player, error / played_[p]);
+      }
+    }
+  }
 }
 
 double RatingsCalc::calculate_errors()
 {
   //return calculate_errors(0, ratings_.size());
-  waiter_.run_and_wait(threads_);
+  if (use_float_)
+  {
+    store_float_ratings();
+  }
 
-  auto abs = std::views::transform(errors_, [](auto e) { return std::fabs(e); });
-  return std::accumulate(abs.begin(), abs.end(), 0.0);
+  waiter_.run_and_wait(pool());
+
+  // combined in job order, so the total doesn't depend on scheduling
+  error_norms_ = {};
+  for (const auto& norms : job_norms_)
+  {
+    error_norms_ += norms;
+  }
+
+  return error_norms_.total;
 }
 
-void do_error_calc(double rating, int j, double& score, const std::vector<int>& opp_index, const std::vector<int>& opp_played, const std::vector<double>& ratings)
+bool RatingsCalc::converged(const ErrorNorms& norms) const
 {
-    auto denom = (rating + ratings[opp_index[j]]);
-    auto numerator = opp_played[j] * rating;
-    score += numerator / denom;
+  const auto& policy = options_.convergence;
+  // with every tolerance off, the solve runs until the iteration or time
+  // limit
+  if (policy.total <= 0 && policy.mean_per_game <= 0 && policy.max_per_player <= 0)
+  {
+    return false;
+  }
+
+  if (policy.total > 0 && norms.total >= policy.total)
+  {
+    return false;
+  }
+
+  if (policy.mean_per_game > 0 && norms.total >= policy.mean_per_game * games_)
+  {
+    return false;
+  }
+
+  if (policy.max_per_player > 0 && norms.max_per_player >= policy.max_per_player)
+  {
+    return false;
+  }
+
+  return true;
 }
 
-void RatingsCalc::calculate_errors(int start, int end)
+bool RatingsCalc::out_of_budget(int iteration) const
 {
-  for (auto p : std::views::iota(start, end))
-  [[likely]]
+  const auto& policy = options_.convergence;
+  if (iteration >= policy.max_iterations)
   {
-    auto& player = player_info_[p];
-    auto rating = ratings_[p];
-    double score = 0;
-    // add the expected score against each opponent
-    auto first = game_indexes_[p];
-    auto last = game_indexes_[p+1];
-    auto distance = last - first;
-    distance &= 0xFFFFFFFE;
+    return true;
+  }
 
-    auto end = first + distance;
+  return policy.time_limit.count() != 0
+    && std::chrono::steady_clock::now() - solve_start_ >= policy.time_limit;
+}
 
-    auto j = first;
-    for (j = first; j < end; j += 2)
-    [[likely]]
-    {
-      do_error_calc(rating, j, score, opp_index_, opp_played_, ratings_);
-      do_error_calc(rating, j+1, score, opp_index_, opp_played_, ratings_);
-    }
 
-    if (j != last)
+void RatingsCalc::calculate_error(int p)
+{
+  player_error_kernel_(kernel_graph(), errors_.data(), p, p + 1);
+}
+
+KernelGraph RatingsCalc::kernel_graph() const
+{
+  return {game_indexes_.data(), opp_index_.data(), opp_played_.data(), scores_.data(), played_.data(),
+    ratings_.data(), float_ratings_.data()};
+}
+
+// Picks the error kernel specialised for this solve, so the choices are
+// made once rather than on every edge.
+void RatingsCalc::select_error_kernel()
+{
+  error_config_.precision = use_float_ ? Precision::Float : Precision::Double;
+  error_config_.unroll = options_.unroll;
+  error_config_.max_per_player = options_.convergence.max_per_player > 0;
+  error_config_.log_domain = log_domain_;
+  error_kernel_ = kernels_->error_kernel(error_config_);
+  if (!error_kernel_)
+  {
+    throw std::string("There is no error kernel for these options");
+  }
+
+  auto player_config = error_config_;
+  player_config.precision = Precision::Double;
+  player_error_kernel_ = kernels_->error_kernel(player_config);
+}
+
+void RatingsCalc::store_float_ratings()
+{
+  parallel_ranges(pool(), work_ranges_, [this](size_t begin, size_t end) {
+    for (size_t p = begin; p != end; ++p)
     {
-      do_error_calc(rating, j, score, opp_index_, opp_played_, ratings_);
+      float_ratings_[p] = std::min(ratings_[p], static_cast<double>(max_float_rating));
     }
+  });
+}
 
-    double e = player.score() - score;
-    errors_[p] = e;
-  }
+ErrorNorms RatingsCalc::calculate_errors(int start, int end)
+{
+  return error_kernel_(kernel_graph(), errors_.data(), start, end);
 }
 
-std::vector<ThreadPool::ThreadJob> RatingsCalc::create_adjust_calculation()
+std::vector<ThreadPool::ThreadJob> RatingsCalc::create_adjust_calculation(
+  void (RatingsCalc::*adjust)(size_t, size_t))
 {
   std::vector<ThreadPool::ThreadJob> jobs;
-  double players = player_info_.size();
+  double players = ratings_.size();
   auto job_count = 8;
   double ratio = players / job_count;
 
@@ -132,8 +679,8 @@ std::vector<ThreadPool::ThreadJob> RatingsCalc::create_adjust_calculation()
   {
     size_t end = ratio * i;
     std::cout << "Adjust ratings: " << begin << "--" << end << std::endl;
-    jobs.push_back([begin, end, this](){
-      adjust_ratings(begin, end);
+    jobs.push_back([begin, end, adjust, this](){
+      (this->*adjust)(begin, end);
     });
     begin = end;
   }
@@ -144,19 +691,19 @@ std::vector<ThreadPool::ThreadJob> RatingsCalc::create_adjust_calculation()
 std::vector<ThreadPool::ThreadJob> RatingsCalc::create_error_calculation()
 {
   //add up the pairings to split by pairings instead of players
-  std::vector<int> accum_games;
-  int games = 0;
+  std::vector<int64_t> accum_games;
+  int64_t games = 0;
 
-  for (size_t i = 0; i != player_info_.size(); ++i)
+  for (size_t i = 0; i != played_.size(); ++i)
   {
-    games += player_info_[i].played();
+    games += played_[i];
     accum_games.push_back(games);
   }
 
-  auto total_games = accum_games.back();
+  auto total_games = accum_games.empty() ? 0 : accum_games.back();
 
   std::vector<ThreadPool::ThreadJob> jobs;
-  int job_count = player_info_.size() / 10000;
+  int job_count = std::max<size_t>(1, played_.size() / 10000);
   std::cout << job_count << " jobs" << std::endl;
 
   auto iter = accum_games.begin();
@@ -165,11 +712,14 @@ std::vector<ThreadPool::ThreadJob> RatingsCalc::create_error_calculation()
   double interval = static_cast<double>(total_games) / job_count;
 
   job_times_.resize(job_count);
+  job_norms_.resize(job_count);
+  work_ranges_.clear();
   for (int i = 0; i != job_count; ++i)
   {
     double next_index = interval * (i+1);
 
-    auto job_end = std::find_if(iter, end_iter, [next_index](auto v) {
+    // the last job always runs to the end, whatever the rounding
+    auto job_end = i == job_count - 1 ? end_iter : std::find_if(iter, end_iter, [next_index](auto v) {
       return v > next_index;
     });
 
@@ -177,10 +727,11 @@ std::vector<ThreadPool::ThreadJob> RatingsCalc::create_error_calculation()
     int end = job_end - accum_games.begin();
 
     std::cout << begin << "--" << end << std::endl;
+    work_ranges_.emplace_back(begin, end);
     jobs.push_back([this, begin, end, i] () {
       Timer timer;
       timer.start();
-      calculate_errors(begin, end);
+      job_norms_[i] = calculate_errors(begin, end);
       auto elapsed = timer.stop();
       job_times_[i] = std::chrono::duration_cast<std::chrono::microseconds>(elapsed);
     });
@@ -193,47 +744,36 @@ std::vector<ThreadPool::ThreadJob> RatingsCalc::create_error_calculation()
 
 void RatingsCalc::adjust_ratings(size_t start, size_t end)
 {
-  auto K = adjust_state_.K;
+  auto adjust = log_domain_ ? kernels_->adjust_log : kernels_->adjust;
+  adjust(kernel_graph(), ratings_.data(), errors_.data(), adjust_state_.K, start, end);
+}
 
-  for (auto p : std::views::iota(start, end))
-  {
-    double e = errors_[p] / played_[p];
-    ratings_[p] = ratings_[p] * std::pow(10, K * e);
-  }
+void RatingsCalc::adjust_ratings_mm(size_t start, size_t end)
+{
+  auto adjust = log_domain_ ? kernels_->adjust_mm_log : kernels_->adjust_mm;
+  adjust(kernel_graph(), ratings_.data(), errors_.data(), start, end);
 }
 
-void RatingsCalc::process_line(std::string_view line)
+double RatingsCalc::updated_rating(size_t p, double rating, double error, double K) const
 {
-  std::string_view white;
-  std::string_view black;
-  std::string_view result;
+  bool mm = options_.solver == Solver::MM;
+  if (log_domain_)
+  {
+    return mm ? mm_log_rating(rating, scores_[p], error, played_[p]) : kstep_log_rating(rating, error, played_[p], K);
+  }
 
-  int i = 0;
+  return mm ? mm_rating(rating, scores_[p], error, played_[p]) : kstep_rating(rating, error, played_[p], K);
+}
 
-  using std::operator""sv;
-  for (auto part : std::views::split(line, ":"sv))
-  { 
-    switch(i)
-    {
-      case 0:
-        white = std::string_view(part.begin(), part.end());
-        break;
-      case 1:
-        black = std::string_view(part.begin(), part.end());
-        break;
-      case 2:
-        result = std::string_view(part.begin(), part.end());
-        break;
-    }
-    ++i;
-  }
-  
-  if (i != 3)
+void RatingsCalc::process_line(const ScannedLine& scanned, GameChunk& chunk)
+{
+  if (scanned.field_count != 3)
   {
-    throw "Line: '" + std::string(line) + "' malformed";
+    throw "Line: '" + std::string(scanned.line) + "' malformed";
   }
 
-  char outcome = result[0];
+  auto [white, black, result] = scanned.fields;
+  char outcome = result.empty() ? '\0' : result[0];
 
   switch(outcome)
   {
@@ -242,107 +782,433 @@ void RatingsCalc::process_line(std::string_view line)
     case 'd':
     break;
     default:
-    throw "Invalid result for " + std::string(line);
+    throw "Invalid result for " + std::string(scanned.line);
   }
 
-  auto w_id = insert_player(white, outcome == 'd' ? 0.5 : outcome == 'w' ? 1 : 0);
-  auto b_id = insert_player(black, outcome == 'd' ? 0.5 : outcome == 'b' ? 1 : 0);
+  chunk.add_game(white, black, outcome);
+}
+
+void RatingsCalc::parse_lines(const char* begin, const char* end, GameChunk& chunk)
+{
+  scan_lines(*kernels_, begin, end, [this, &chunk](const ScannedLine& scanned) {
+    process_line(scanned, chunk);
+  });
+}
+
+void RatingsCalc::merge_chunk(const GameChunk& chunk)
+{
+  chunk.check();
 
-  add_match(w_id, b_id, outcome == 'd' ? 0.5 : outcome == 'w' ? 1 : -1);
+  std::vector<int> ids;
+  ids.reserve(chunk.names().size());
+  for (auto name : chunk.names())
+  {
+    ids.push_back(names_.intern(name));
+  }
 
-  ++games_;
+  for (const auto& game : chunk.games())
+  {
+    add_game(ids[game.white], ids[game.black], game.result);
+  }
 }
 
-void RatingsCalc::read_games(const char* file_name)
+RatingsCalc::FormatParser RatingsCalc::format_parser(InputFormat format)
 {
-  Timer timer;
-  timer.start();
+  switch (format)
+  {
+    case InputFormat::Pgn:
+    return {next_pgn_game, last_pgn_game, parse_pgn};
 
-  file = std::make_unique<MappedFile>(file_name);
+    case InputFormat::Lines:
+    default:
+    return {next_line, last_line,
+      [this](const char* begin, const char* end, GameChunk& chunk) {
+        parse_lines(begin, end, chunk);
+      }};
+  }
+}
 
-  auto length = file->length();
-  auto* memory = file->memory();
+void RatingsCalc::parse_chunks(const char* memory, size_t length,
+  const FormatParser& parser)
+{
+  // Whether the pool is small enough to solve without threads isn't known
+  // until the games are read, so parsing has threads of its own, which end
+  // with the parse, rather than starting the solver's pool.
+  size_t workers = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+  // Split into chunks, several per thread so that one slow chunk doesn't
+  // hold up the others.
+  const char* memory_end = memory + length;
+  size_t chunk_count = length / (1024 * 1024);
+  chunk_count = chunk_count > 1 ? std::min(chunk_count, workers * 4) : 1;
+
+  std::vector<std::pair<const char*, const char*>> ranges;
+  const char* begin = memory;
+  for (size_t i = 1; i <= chunk_count && begin < memory_end; ++i)
+  {
+    const char* end = memory_end;
+    if (i != chunk_count)
+    {
+      end = parser.next(std::max(memory + length / chunk_count * i, begin), memory_end);
+    }
 
-  std::cout << "File is " << length << " bytes" << std::endl;
+    ranges.emplace_back(begin, end);
+    begin = end;
+  }
 
-  int i = 0;
+  std::vector<GameChunk> chunks(ranges.size());
+  std::atomic<size_t> next = 0;
+  auto parse = [&]() {
+    for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < ranges.size(); )
+    {
+      try
+      {
+        parser.parse(ranges[i].first, ranges[i].second, chunks[i]);
+      } catch(...)
+      {
+        chunks[i].set_error(std::current_exception());
+      }
+    }
+  };
 
-  const char* line_begin = memory;
-  while (i < length)
   {
-    if (i % (1024 * 1024) == 0)
+    std::vector<std::jthread> threads;
+    for (size_t t = 1; t < std::min(workers, ranges.size()); ++t)
     {
-      std::cout << "." << std::flush;
+      threads.emplace_back(parse);
     }
+    parse();
+  }
 
+  // merge in file order so that player ids don't depend on scheduling
+  for (const auto& chunk : chunks)
+  {
+    merge_chunk(chunk);
+    std::cout << "." << std::flush;
+  }
+}
 
-    if (memory[i] == '\n')
+void RatingsCalc::parse_stream(StreamReader& reader, const FormatParser& parser)
+{
+  // the partial record at the end of the last buffer
+  std::vector<char> carry;
+
+  while (auto* buffer = reader.next())
+  {
+    char* begin = buffer->data();
+    char* end = begin + buffer->length;
+
+    if (carry.size() <= StreamReader::headroom)
+    {
+      begin -= carry.size();
+      std::copy(carry.begin(), carry.end(), begin);
+    }
+    else
     {
-      process_line(std::string_view(line_begin, &memory[i]));
-      line_begin = &memory[i+1];
+      // a record longer than the headroom, which should never happen with
+      // real games, so just join them up
+      carry.insert(carry.end(), begin, end);
+      begin = carry.data();
+      end = begin + carry.size();
     }
 
-    ++i;
+    auto* complete = parser.last(begin, end);
+    parse_chunks(begin, complete - begin, parser);
+
+    std::vector<char> rest(complete, static_cast<const char*>(end));
+    carry.swap(rest);
+    reader.release(buffer);
   }
 
-  if (line_begin < &memory[i])
+  parse_chunks(carry.data(), carry.size(), parser);
+}
+
+void RatingsCalc::load_binary(const char* memory, size_t length)
+{
+  BinaryGamesView view(memory, length);
+
+  // the names are already unique and numbered, so nothing is hashed
+  auto players = view.players();
+  player_info_.resize(players);
+  names_.reserve(players, view.name_bytes());
+  for (size_t p = 0; p != players; ++p)
   {
-    process_line(std::string_view(line_begin, &memory[i]));
+    names_.append(view.name(p));
   }
 
-  ratings_.resize(players_.size(), 1);
-  errors_.resize(players_.size(), 0);
-  game_indexes_.push_back(0);
-  std::for_each(player_info_.begin(), player_info_.end(), [this](auto& info)
+  for (const auto& game : view.games())
   {
-    info.finalize(opponent_info_);
-    played_.push_back(info.played());
-    game_indexes_.push_back(info.first_opponent() + info.opponents());
-  });
+    if (game.white >= players || game.black() >= players || game.result() == '?')
+    {
+      throw std::string("Binary games file has a corrupt game");
+    }
+
+    add_game(game.white, game.black(), game.result());
+  }
+}
+
+void RatingsCalc::parse_windows(MappedFile& file, const FormatParser& parser)
+{
+  auto length = file.length();
 
-  std::ranges::for_each(opponent_info_, [this](auto& info)
+  size_t offset = 0;
+  while (offset < length)
   {
-    auto [index, played] = info;
-    opp_index_.push_back(index);
-    opp_played_.push_back(played);
-  });
+    auto window = file.map_window(offset);
+    if (offset == 0 && (is_binary_games(window.data(), window.size()) ||
+      open_decompressor(window.data(), window.size())))
+    {
+      throw std::string("Only plain text input can be mapped in windows");
+    }
 
-  timer.stop("read_games");
+    // the next window starts at the partial record at the end of this one
+    auto* end = window.data() + window.size();
+    if (offset + window.size() != length)
+    {
+      end = parser.last(window.data(), end);
+      if (end == window.data())
+      {
+        throw std::string("A game is longer than the mapping window");
+      }
+    }
+
+    parse_chunks(window.data(), end - window.data(), parser);
+    offset += end - window.data();
+  }
+}
+
+void RatingsCalc::load_games(const char* file_name, InputFormat format)
+{
+  auto parser = format_parser(format);
 
-  std::cout << players_.size() << " players" << std::endl;
+  // pipes and stdin can't be mapped, so they are read through a double
+  // buffered stream instead
+  struct stat sb;
+  if (std::string_view(file_name) == "-" || (stat(file_name, &sb) == 0 && !S_ISREG(sb.st_mode)))
+  {
+    std::cout << "Streaming " << file_name << std::endl;
+
+    StreamReader reader(std::make_unique<FileSource>(file_name), 2);
+    parse_stream(reader, parser);
+  }
+  else
+  {
+    // the names are copied out as they are interned, so the file is only
+    // needed while it is read
+    MappedFile file(file_name, options_.map_window);
+
+    auto length = file.length();
+    auto* memory = file.memory();
+
+    std::cout << "File is " << length << " bytes" << std::endl;
+
+    if (options_.map_window != 0)
+    {
+      parse_windows(file, parser);
+    }
+    else if (is_binary_games(memory, length))
+    {
+      load_binary(memory, length);
+    }
+    else if (auto source = open_decompressor(memory, length))
+    {
+      StreamReader reader(std::move(source));
+      parse_stream(reader, parser);
+    }
+    else
+    {
+      parse_chunks(memory, length, parser);
+    }
+  }
+  std::cout << std::endl;
+
+  std::cout << names_.size() << " players" << std::endl;
   std::cout << games_ << " games" << std::endl;
+}
+
+void RatingsCalc::convert_games(const char* file_name, InputFormat format, const char* output)
+{
+  Timer timer;
+  timer.start();
+
+  load_games(file_name, format);
+
+  std::vector<std::string_view> names;
+  names.reserve(names_.size());
+  for (size_t p = 0; p != names_.size(); ++p)
+  {
+    names.push_back(names_.name(p));
+  }
+
+  write_binary_games(output, names, game_list_);
+
+  timer.stop("convert_games");
+}
+
+void RatingsCalc::read_games(const char* file_name, InputFormat format)
+{
+  Timer timer;
+  timer.start();
+
+  load_games(file_name, format);
+  report_memory("ingest");
+  build_graph();
+
+  timer.stop("read_games");
+  report_memory("graph");
 
   #if 0
   std::ofstream out("playerinfo.txt");
   out << "Players" << std::endl;
-  for (auto& i : player_names_)
+  for (size_t i = 0; i != names_.size(); ++i)
   {
-    out << i.first << ": " << i.second << std::endl;
+    out << i << ": " << names_.name(i) << std::endl;
   }
 
   out << "Player matches" << std::endl;
-  int p_num = 0;
-  for (auto& p : player_info_)
+  for (size_t p = 0; p != scores_.size(); ++p)
   {
-    out << p_num << " played " << p.played() << " scored " << p.score() << std::endl;
-    for (auto& [player, games, score] : p.matchups())
+    out << p << " played " << played_[p] << " scored " << scores_[p] << std::endl;
+    for (auto j = game_indexes_[p]; j != game_indexes_[p+1]; ++j)
     {
-      out << "    played " << player << " " << games << " " << score << std::endl;
+      out << "    played " << opp_index_[j] << " " << opp_played_[j] << std::endl;
     }
-    ++p_num;
   }
   #endif
 
   init_jobs();
 }
 
+void RatingsCalc::build_graph()
+{
+  auto players = names_.size();
+  small_ = players <= max_dense_players;
+
+  ratings_.resize(players, 1);
+  errors_.resize(players, 0);
+  played_.resize(players);
+  scores_.resize(players);
+  for (size_t p = 0; p != players; ++p)
+  {
+    played_[p] = player_info_[p].played();
+    scores_[p] = player_info_[p].score();
+  }
+
+  // nothing from here on looks names up or needs the per player totals
+  names_.release_index();
+  player_info_ = std::vector<Player>();
+
+  // Group every game under both of its players with a counting sort: each
+  // player gets a slot per game they played, and the games are scattered
+  // into those slots.
+  std::vector<size_t> slots;
+  parallel_prefix_sum(pool(), players, [this](size_t p) -> size_t {
+    return played_[p];
+  }, slots);
+
+  std::vector<uint32_t> opponents(slots.back());
+  {
+    std::vector<size_t> cursor(slots.begin(), slots.end() - 1);
+    parallel_for(pool(), game_list_.size(), [&](size_t begin, size_t end) {
+      for (size_t g = begin; g != end; ++g)
+      {
+        auto white = game_list_[g].white;
+        auto black = game_list_[g].black();
+        opponents[std::atomic_ref(cursor[white]).fetch_add(1, std::memory_order_relaxed)] = black;
+        opponents[std::atomic_ref(cursor[black]).fetch_add(1, std::memory_order_relaxed)] = white;
+      }
+    });
+  }
+
+  // the game list is the biggest staging structure, so free it before the
+  // counts are allocated
+  game_list_ = std::vector<BinaryGame>();
+
+  // Sort each player's opponents, which also makes the scatter order above
+  // irrelevant, and squash repeats into a count at the front of the slots.
+  std::vector<uint32_t> counts(opponents.size());
+  std::vector<int> distinct(players);
+  parallel_for(pool(), players, [&](size_t begin, size_t end) {
+    for (size_t p = begin; p != end; ++p)
+    {
+      auto first = opponents.begin() + slots[p];
+      auto last = opponents.begin() + slots[p+1];
+      std::sort(first, last);
+
+      int unique = 0;
+      for (auto it = first; it != last; ++it)
+      {
+        if (unique != 0 && first[unique - 1] == *it)
+        {
+          ++counts[slots[p] + unique - 1];
+        }
+        else
+        {
+          first[unique] = *it;
+          counts[slots[p] + unique] = 1;
+          ++unique;
+        }
+      }
+      distinct[p] = unique;
+    }
+  }, 256);
+
+  parallel_prefix_sum(pool(), players, [&distinct](size_t p) {
+    return distinct[p];
+  }, game_indexes_);
+
+  opp_index_.resize(game_indexes_.back());
+  opp_played_.resize(game_indexes_.back());
+  parallel_for(pool(), players, [&](size_t begin, size_t end) {
+    for (size_t p = begin; p != end; ++p)
+    {
+      std::copy_n(opponents.begin() + slots[p], distinct[p], opp_index_.begin() + game_indexes_[p]);
+      std::copy_n(counts.begin() + slots[p], distinct[p], opp_played_.begin() + game_indexes_[p]);
+    }
+  }, 256);
+}
+
+void RatingsCalc::report_memory(const char* phase)
+{
+  if (!options_.memory_report)
+  {
+    return;
+  }
+
+  std::pair<const char*, size_t> structures[] = {
+    {"name arena", names_.arena_bytes()},
+    {"name offsets", names_.offsets_bytes()},
+    {"name index", names_.index_bytes()},
+    {"player info", vector_bytes(player_info_)},
+    {"game list", vector_bytes(game_list_)},
+    {"game indexes", vector_bytes(game_indexes_)},
+    {"opponent index", vector_bytes(opp_index_)},
+    {"opponent played", vector_bytes(opp_played_)},
+    {"scores", vector_bytes(scores_)},
+    {"played", vector_bytes(played_)},
+    {"ratings", vector_bytes(ratings_)},
+    {"errors", vector_bytes(errors_)},
+  };
+
+  std::cout << "Memory after " << phase << std::endl;
+  size_t total = 0;
+  for (auto [name, bytes] : structures)
+  {
+    std::cout << "  " << name << ": " << bytes << " bytes" << std::endl;
+    total += bytes;
+  }
+  std::cout << "  total: " << total << " bytes" << std::endl;
+  std::cout << "  current RSS: " << current_rss() << " bytes" << std::endl;
+  std::cout << "  peak RSS: " << peak_rss() << " bytes" << std::endl;
+}
+
 void RatingsCalc::print_ratings(const char* file)
 {
   std::vector<std::tuple<double, double, std::string>> ratings;
 
   for (auto p : std::views::iota(0u, ratings_.size()))
   {
-    ratings.emplace_back(ratings_[p], errors_[p], player_names_[p]);
+    ratings.emplace_back(ratings_[p], errors_[p], names_.name(p));
   }
 
   std::sort(ratings.begin(), ratings.end(), [](const auto& a, const auto& b) {
@@ -357,13 +1223,18 @@ void RatingsCalc::print_ratings(const char* file)
   }
 }
 
-RatingsCalc::RatingsCalc() {}
+RatingsCalc::RatingsCalc(RatingsOptions options)
+: options_(options)
+, kernels_(&kernels_for(options.isa))
+{
+}
 
 void RatingsCalc::init_jobs()
 {
   error_jobs_ = create_error_calculation();
   waiter_.set_jobs(error_jobs_);
 
-  adjust_jobs_ = create_adjust_calculation();
+  adjust_jobs_ = create_adjust_calculation(options_.solver == Solver::MM
+    ? &RatingsCalc::adjust_ratings_mm : &RatingsCalc::adjust_ratings);
   adjust_waiter_.set_jobs(adjust_jobs_);
 }
@@ -1,45 +1,167 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
-#include <absl/container/flat_hash_map.h>
 
+#include "binary_games.h"
+#include "kernels.h"
+#include "game_chunk.h"
+#include "multigrid.h"
+#include "name_interner.h"
 #include "player.h"
+#include "step_sizes.h"
+#include "threads/parallel.h"
 #include "threads/threads.h"
 #include "threads/waiter.h"
 
 class MappedFile;
+class StreamReader;
+struct ScannedLine;
+
+enum class InputFormat
+{
+  // white:black:result lines
+  Lines,
+  Pgn,
+};
+
+enum class Solver
+{
+  // the kstep update with K picked each iteration by a secant estimate and
+  // backtracking, so the total error never increases
+  Adaptive,
+  // multiplicative steps of the normalised error with a scheduled K
+  KStep,
+  // Hunter's minorization-maximization update for Bradley-Terry
+  MM,
+  // Newton steps on the log ratings, solved with preconditioned CG
+  Newton,
+};
+
+Solver solver_from_name(const std::string& name);
+const char* solver_name(Solver solver);
+
+// When the solvers stop. Each tolerance is only checked if it is above
+// zero, and all of those checked must hold. With none above zero, only
+// the iteration and time limits stop the solve.
+struct ConvergencePolicy
+{
+  // the sum of |error| over all players
+  double total = 0.5;
+  // the sum of |error| divided by the number of games
+  double mean_per_game = 0;
+  // the largest |error| / played of any player
+  double max_per_player = 0;
+
+  int max_iterations = 100000;
+  // stop after this long even if not converged, zero for no limit
+  std::chrono::milliseconds time_limit{0};
+};
+
+struct RatingsOptions
+{
+  ConvergencePolicy convergence;
+
+  Solver solver = Solver::Adaptive;
+
+  // the instruction set of the kernels
+  Isa isa = best_isa();
+
+  // the separate sums per player in the error kernel, 1, 2 or 4
+  int unroll = 1;
+
+  // Map the input this many bytes at a time instead of all at once. Zero
+  // maps the whole file.
+  size_t map_window = 0;
+
+  // Print the memory used by each structure, and the peak RSS, after each
+  // phase.
+  bool memory_report = false;
+
+  // Anderson acceleration of the kstep and mm solvers, mixing this many
+  // previous steps. Zero runs the plain iteration.
+  int anderson = 0;
+
+  // Run kstep or mm as asynchronous Gauss-Seidel, with each thread updating
+  // its players in place and no barrier between sweeps.
+  bool async = false;
+
+  // Run kstep or mm one player at a time from a queue of the players with
+  // the largest errors, updating the errors of their opponents as they go.
+  bool push = false;
+
+  // Only update the players whose errors are still above a threshold, and
+  // their opponents, between periodic full passes.
+  bool active_set = false;
+
+  // Warm start the solver with aggregation multigrid corrections.
+  bool multigrid = false;
+
+  // Solve first with the error pass reading a float copy of the ratings,
+  // then refine in double.
+  bool float_ratings = false;
+
+  // Keep the ratings as natural logs while solving, which needs no pow in
+  // the kstep update and doesn't overflow for extreme players.
+  bool log_ratings = false;
+};
 
 class RatingsCalc
 {
   public:
-  RatingsCalc();
+  RatingsCalc(RatingsOptions options = {});
 
-  void read_games(const char* file);
+  void read_games(const char* file, InputFormat format = InputFormat::Lines);
+  // Writes the games in file to output in the binary games format
+  void convert_games(const char* file, InputFormat format, const char* output);
   void find_ratings();
+  // Times the error kernel of each instruction set on one thread over the
+  // games read, and checks them against the scalar kernel.
+  void benchmark_kernels();
 
   void print_ratings(const char* file);
 
   private:
 
-  //<index, played vs>
-  using Opponent = std::tuple<size_t, size_t>;
+  RatingsOptions options_;
+  const Kernels* kernels_;
+  // the error kernel for this solve, and the double one for single players
+  ErrorKernelConfig error_config_;
+  ErrorKernel error_kernel_ = nullptr;
+  ErrorKernel player_error_kernel_ = nullptr;
 
-  absl::flat_hash_map<std::string_view, int> players_;
-  absl::flat_hash_map<int, std::string_view> player_names_;
+  NameInterner names_;
+  // only used while reading, the solve just needs scores_
   std::vector<Player> player_info_;
-  std::vector<Opponent> opponent_info_;
-  std::vector<int> game_indexes_;
+  std::vector<double> scores_;
+  // 64 bit, since a full history has more than 2^31 games
+  std::vector<int64_t> game_indexes_;
   std::vector<int> opp_index_;
   std::vector<int> opp_played_;
   std::vector<double> errors_;
   std::vector<int> played_;
-  int next_player_ = 0;
-  int games_ = 0;
+  int64_t games_ = 0;
+
+  // every game in the order it was read, which build_graph sorts into the
+  // opponent arrays
+  std::vector<BinaryGame> game_list_;
 
   std::vector<double> ratings_;
+  // the float copy of ratings_ the error pass reads while use_float_ is set
+  std::vector<float> float_ratings_;
+  bool use_float_ = false;
+  // ratings_ holds natural logs during a --log-ratings solve
+  bool log_domain_ = false;
 
-  ThreadPool threads_;
+  // Created on first use, and never for pools small enough for the dense
+  // solver, which run everything on the calling thread.
+  std::unique_ptr<ThreadPool> threads_;
+  bool small_ = false;
   std::vector<ThreadPool::ThreadJob> error_jobs_;
   std::vector<ThreadPool::ThreadJob> adjust_jobs_;
   ThreadPoolWaiter waiter_;
@@ -47,27 +169,119 @@ class RatingsCalc
 
   std::vector<std::chrono::microseconds> job_times_;
 
-  void process_line(std::string_view line);
+  // the norms each error job found, and their combination from the last
+  // error pass
+  std::vector<ErrorNorms> job_norms_;
+  ErrorNorms error_norms_;
+  // set when the adaptive solver stops because no step lowers the error
+  bool stalled_ = false;
+  std::chrono::steady_clock::time_point solve_start_;
+
+  // the players each error job covers, balanced by games played, for
+  // anything else that walks the opponent arrays in parallel
+  JobRanges work_ranges_;
+
+  // the coarse levels of the player graph, only kept during the multigrid
+  // warm start
+  std::vector<MultigridLevel> levels_;
+
+  // the players the active set mode is updating, and those whose errors
+  // that changes
+  std::vector<int> active_;
+  std::vector<int> active_errors_;
+  // the norms of the errors that don't change until the next full pass
+  ErrorNorms frozen_norms_;
+
+  using ChunkBoundary = std::function<const char*(const char*, const char*)>;
+  using ChunkParser = std::function<void(const char*, const char*, GameChunk&)>;
+
+  // How to split and parse one input format. next finds the first record
+  // at or after a point, and last finds where the final, possibly
+  // incomplete, record of a block begins.
+  struct FormatParser
+  {
+    ChunkBoundary next;
+    ChunkBoundary last;
+    ChunkParser parse;
+  };
+
+  FormatParser format_parser(InputFormat format);
+  void parse_chunks(const char* memory, size_t length,
+    const FormatParser& parser);
+  void parse_stream(StreamReader& reader, const FormatParser& parser);
+  void process_line(const ScannedLine& scanned, GameChunk& chunk);
+  void parse_lines(const char* begin, const char* end, GameChunk& chunk);
+  void merge_chunk(const GameChunk& chunk);
+  void load_games(const char* file_name, InputFormat format);
+  void load_binary(const char* memory, size_t length);
+  void parse_windows(MappedFile& file, const FormatParser& parser);
+  void build_graph();
+  void report_memory(const char* phase);
   double calculate_errors();
+  int solve();
+  void store_float_ratings();
+  int solve_fixed_point();
+  int solve_adaptive();
+  int solve_dense();
+  int solve_anderson();
+  int solve_async();
+  int solve_push();
+  int solve_active_set();
+  void compact_active_set(double total_error);
+  void multigrid_setup();
+  void multigrid_restrict();
+  void multigrid_warm_start();
+  int solve_newton();
+  void newton_diagonal(std::vector<double>& diagonal);
+  double hessian_product(const std::vector<double>& v, std::vector<double>& result);
+  int conjugate_gradient(const std::vector<double>& diagonal, std::vector<double>& x);
   void adjust_ratings_driver(int i, double e);
-  void calculate_errors(int start, int end);
+  ErrorNorms calculate_errors(int start, int end);
+  KernelGraph kernel_graph() const;
+  void select_error_kernel();
+  bool converged(const ErrorNorms& norms) const;
+  bool converged() const
+  {
+    return converged(error_norms_);
+  }
+  bool out_of_budget(int iteration) const;
+  void report_convergence();
   void adjust_ratings(size_t start, size_t end);
+  // The kstep or MM update of player p from rating and error, whichever the
+  // solver uses, in the domain the ratings are in.
+  double updated_rating(size_t p, double rating, double error, double K) const;
+  void adjust_ratings_mm(size_t start, size_t end);
   std::vector<ThreadPool::ThreadJob> create_error_calculation();
-  std::vector<ThreadPool::ThreadJob> create_adjust_calculation();
+  std::vector<ThreadPool::ThreadJob> create_adjust_calculation(
+    void (RatingsCalc::*adjust)(size_t, size_t));
   void init_jobs();
 
-  int insert_player(std::string_view player, double score)
+  void calculate_error(int p);
+
+  // The pool to run parallel work on, or null to run it on this thread.
+  ThreadPool* pool()
   {
-    auto inserted = players_.try_emplace(player, next_player_);
-    if (inserted.second)
+    if (small_)
     {
-      player_names_.emplace(next_player_, player);
-      ++next_player_;
+      return nullptr;
     }
-    
-    add_score(inserted.first->second, score);
 
-    return inserted.first->second;
+    if (!threads_)
+    {
+      threads_ = std::make_unique<ThreadPool>();
+    }
+
+    return threads_.get();
+  }
+
+  void add_game(int white, int black, char outcome)
+  {
+    add_score(white, outcome == 'd' ? 0.5 : outcome == 'w' ? 1 : 0);
+    add_score(black, outcome == 'd' ? 0.5 : outcome == 'b' ? 1 : 0);
+
+    game_list_.push_back(make_binary_game(white, black, outcome));
+
+    ++games_;
   }
 
   void add_score(size_t player, double score)
@@ -80,20 +294,10 @@ class RatingsCalc
     player_info_[player].add_score(score);
   }
 
-  void add_match(int white, int black, double score)
-  {
-    auto& w_info = player_info_[white];
-    auto& b_info = player_info_[black];
-
-    w_info.add_matchup(black, score >= 0 ? score : 0);
-    b_info.add_matchup(white, score == 0.5 ? 0.5 : score < 0 ? -score : 0);
-  }
-
-  std::unique_ptr<MappedFile> file;
 
   struct {
     int iteration = 0;
-    double K = 1.6; 
+    double K = kstep_k;
   } adjust_state_;
 };
 
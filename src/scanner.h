@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+
+#include "kernels.h"
+
+// One "white:black:result" line split on its first two colons. field_count
+// is the number of fields the line really had, so callers can reject lines
+// with too few or too many.
+struct ScannedLine
+{
+  std::string_view line;
+  std::string_view fields[3];
+  int field_count;
+};
+
+// Calls f(const ScannedLine&) for every line in [begin, end). A final line
+// without a trailing newline is still reported. The delimiters are found by
+// the kernels, a window at a time.
+template <typename F>
+void scan_lines(const Kernels& kernels, const char* begin, const char* end, F&& f)
+{
+  const char* line_begin = begin;
+  const char* colons[2] = {begin, begin};
+  int colon_count = 0;
+
+  auto emit = [&](const char* line_end)
+  {
+    ScannedLine scanned;
+    scanned.line = std::string_view(line_begin, line_end);
+    scanned.field_count = colon_count + 1;
+    if (colon_count >= 2)
+    {
+      scanned.fields[0] = std::string_view(line_begin, colons[0]);
+      scanned.fields[1] = std::string_view(colons[0] + 1, colons[1]);
+      scanned.fields[2] = std::string_view(colons[1] + 1, line_end);
+    }
+    f(scanned);
+  };
+
+  auto delimiter = [&](const char* p)
+  {
+    if (*p == ':')
+    {
+      if (colon_count < 2)
+      {
+        colons[colon_count] = p;
+      }
+      ++colon_count;
+    }
+    else
+    {
+      emit(p);
+      line_begin = p + 1;
+      colon_count = 0;
+    }
+  };
+
+  constexpr size_t window = 4096;
+  uint32_t positions[window];
+  for (const char* p = begin; p != end;)
+  {
+    size_t length = std::min<size_t>(window, end - p);
+    auto count = kernels.delimiters(p, length, positions);
+    for (size_t i = 0; i != count; ++i)
+    {
+      delimiter(p + positions[i]);
+    }
+    p += length;
+  }
+
+  if (line_begin < end)
+  {
+    emit(end);
+  }
+}
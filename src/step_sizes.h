@@ -0,0 +1,11 @@
+#pragma once
+
+// Step sizes shared by the solvers.
+
+// The kstep K when it isn't scheduled or searched for, which is close to a
+// Newton step for a single player.
+constexpr double kstep_k = 1.6;
+
+// Players that have won or lost every game have no finite rating, and
+// their steps grow without bound, so each step on a log rating is capped.
+constexpr double max_log_step = 2.0;
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Somewhere to read the games from, a block at a time.
+class ByteSource
+{
+  public:
+  virtual ~ByteSource() = default;
+
+  // Reads up to size bytes into buffer, returning 0 at the end of the stream.
+  virtual size_t read(char* buffer, size_t size) = 0;
+};
+
+// Reads a file with read(2), for inputs that can't be mapped such as pipes
+// and stdin, which is given as "-".
+class FileSource : public ByteSource
+{
+  public:
+  FileSource(const char* file)
+  {
+    if (std::string_view(file) != "-")
+    {
+      fd_ = open(file, O_RDONLY);
+      if (fd_ == -1)
+      {
+        throw std::string("Unable to open input file ") + file;
+      }
+    }
+  }
+
+  ~FileSource()
+  {
+    if (fd_ != 0)
+    {
+      close(fd_);
+    }
+  }
+
+  size_t read(char* buffer, size_t size) override
+  {
+    while (true)
+    {
+      auto got = ::read(fd_, buffer, size);
+      if (got >= 0)
+      {
+        return got;
+      }
+
+      if (errno != EINTR)
+      {
+        throw std::string("Error reading input: ") + std::strerror(errno);
+      }
+    }
+  }
+
+  private:
+  int fd_ = 0;
+};
+
+// Fills fixed size buffers from a ByteSource on its own thread, so that
+// reading or decompressing the next buffer overlaps with parsing the current
+// one.
+class StreamReader
+{
+  public:
+  static constexpr size_t buffer_size = 16 << 20;
+
+  // Each buffer keeps this much space in front of its data, so that the
+  // partial record at the end of the previous buffer can be copied in front
+  // of it.
+  static constexpr size_t headroom = 1 << 20;
+
+  struct Buffer
+  {
+    std::vector<char> storage = std::vector<char>(headroom + buffer_size);
+    size_t length = 0;
+
+    char* data()
+    {
+      return storage.data() + headroom;
+    }
+  };
+
+  StreamReader(std::unique_ptr<ByteSource> source, int buffers = 3)
+  : source_(std::move(source))
+  , buffers_(buffers)
+  {
+    for (auto& buffer : buffers_)
+    {
+      free_.push(&buffer);
+    }
+
+    thread_ = std::thread(&StreamReader::fill_loop, this);
+  }
+
+  ~StreamReader()
+  {
+    {
+      std::unique_lock lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+
+    thread_.join();
+  }
+
+  // The next filled buffer, or nullptr at the end of the stream. The buffer
+  // must be given back with release once it has been parsed.
+  Buffer* next()
+  {
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [this]() {
+      return !filled_.empty() || done_;
+    });
+
+    if (!filled_.empty())
+    {
+      auto* buffer = filled_.front();
+      filled_.pop();
+      return buffer;
+    }
+
+    if (error_)
+    {
+      std::rethrow_exception(error_);
+    }
+
+    return nullptr;
+  }
+
+  void release(Buffer* buffer)
+  {
+    {
+      std::unique_lock lock(mutex_);
+      free_.push(buffer);
+    }
+    cv_.notify_all();
+  }
+
+  private:
+  std::unique_ptr<ByteSource> source_;
+  std::vector<Buffer> buffers_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::queue<Buffer*> free_;
+  std::queue<Buffer*> filled_;
+  bool done_ = false;
+  bool stop_ = false;
+  std::exception_ptr error_;
+
+  std::thread thread_;
+
+  void fill_loop()
+  {
+    try
+    {
+      while (true)
+      {
+        Buffer* buffer;
+        {
+          std::unique_lock lock(mutex_);
+          cv_.wait(lock, [this]() {
+            return !free_.empty() || stop_;
+          });
+
+          if (stop_) { return; }
+          buffer = free_.front();
+          free_.pop();
+        }
+
+        // fill the whole buffer so that every parse step gets a full block
+        buffer->length = 0;
+        while (buffer->length != buffer_size)
+        {
+          auto got = source_->read(buffer->data() + buffer->length,
+            buffer_size - buffer->length);
+          if (got == 0)
+          {
+            break;
+          }
+          buffer->length += got;
+        }
+
+        bool finished = buffer->length != buffer_size;
+
+        {
+          std::unique_lock lock(mutex_);
+          if (buffer->length != 0)
+          {
+            filled_.push(buffer);
+          }
+          done_ = finished;
+        }
+        cv_.notify_all();
+
+        if (finished)
+        {
+          return;
+        }
+      }
+    } catch(...)
+    {
+      {
+        std::unique_lock lock(mutex_);
+        error_ = std::current_exception();
+        done_ = true;
+      }
+      cv_.notify_all();
+    }
+  }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+#include "threads.h"
+#include "waiter.h"
+
+// These all take a null pool to mean running everything on the calling
+// thread.
+
+// Half open ranges of items for each job.
+using JobRanges = std::vector<std::pair<size_t, size_t>>;
+
+// Runs f(begin, end) for each range on the pool, and waits for them all to
+// finish.
+template <typename F>
+void parallel_ranges(ThreadPool* pool, const JobRanges& ranges, F&& f)
+{
+  std::vector<ThreadPool::ThreadJob> jobs;
+  for (auto [begin, end] : ranges)
+  {
+    jobs.push_back([&f, begin, end]() {
+      f(begin, end);
+    });
+  }
+
+  ThreadPoolWaiter waiter;
+  waiter.set_jobs(jobs);
+  waiter.run_and_wait(pool);
+}
+
+// The sum of f(begin, end) over the ranges, for any result type with +=.
+// The partial sums are added in range order, so the result doesn't depend
+// on scheduling.
+template <typename F>
+auto parallel_sum(ThreadPool* pool, const JobRanges& ranges, F&& f)
+{
+  using Result = std::invoke_result_t<F, size_t, size_t>;
+
+  std::vector<Result> partial(ranges.size());
+  std::vector<ThreadPool::ThreadJob> jobs;
+  for (size_t i = 0; i != ranges.size(); ++i)
+  {
+    jobs.push_back([&f, &partial, &ranges, i]() {
+      partial[i] = f(ranges[i].first, ranges[i].second);
+    });
+  }
+
+  ThreadPoolWaiter waiter;
+  waiter.set_jobs(jobs);
+  waiter.run_and_wait(pool);
+
+  Result total{};
+  for (const auto& sum : partial)
+  {
+    total += sum;
+  }
+
+  return total;
+}
+
+// The most blocks to split work into, a few per thread.
+inline size_t pool_blocks(ThreadPool* pool)
+{
+  return pool == nullptr ? 1 : pool->pool_size() * 4;
+}
+
+// Splits [0, count) into blocks of at least min_block items. There are a
+// few blocks per thread so that an uneven block doesn't hold everything up.
+inline JobRanges block_ranges(ThreadPool* pool, size_t count, size_t min_block = 4096)
+{
+  size_t blocks = std::clamp<size_t>(count / min_block, 1, pool_blocks(pool));
+
+  JobRanges ranges;
+  for (size_t i = 0; i != blocks; ++i)
+  {
+    ranges.emplace_back(count * i / blocks, count * (i + 1) / blocks);
+  }
+
+  return ranges;
+}
+
+// Runs f(begin, end) over blocks of [0, count) on the pool, and waits for
+// them all to finish.
+template <typename F>
+void parallel_for(ThreadPool* pool, size_t count, F&& f, size_t min_block = 4096)
+{
+  parallel_ranges(pool, block_ranges(pool, count, min_block), f);
+}
+
+// Sets offsets to the exclusive prefix sum of value(i) for i in [0, count),
+// with the total in offsets[count]. Each block sums its values, the block
+// totals are scanned, and then each block writes its offsets.
+template <typename T, typename F>
+void parallel_prefix_sum(ThreadPool* pool, size_t count, F&& value, std::vector<T>& offsets)
+{
+  offsets.resize(count + 1);
+
+  size_t blocks = std::clamp<size_t>(count / 65536, 1, pool_blocks(pool));
+  std::vector<T> block_start(blocks + 1, 0);
+
+  auto block_range = [count, blocks](size_t block) {
+    return std::pair(count * block / blocks, count * (block + 1) / blocks);
+  };
+
+  parallel_for(pool, blocks, [&](size_t first, size_t last) {
+    for (size_t block = first; block != last; ++block)
+    {
+      auto [begin, end] = block_range(block);
+      T sum = 0;
+      for (size_t i = begin; i != end; ++i)
+      {
+        sum += value(i);
+      }
+      block_start[block + 1] = sum;
+    }
+  }, 1);
+
+  std::partial_sum(block_start.begin(), block_start.end(), block_start.begin());
+
+  parallel_for(pool, blocks, [&](size_t first, size_t last) {
+    for (size_t block = first; block != last; ++block)
+    {
+      auto [begin, end] = block_range(block);
+      T sum = block_start[block];
+      for (size_t i = begin; i != end; ++i)
+      {
+        offsets[i] = sum;
+        sum += value(i);
+      }
+    }
+  }, 1);
+
+  offsets[count] = block_start[blocks];
+}
@@ -1,9 +1,10 @@
 #include "threads.h"
+#include <algorithm>
 #include <iostream>
 
 ThreadPool::ThreadPool()
 {
-  int cpus = std::thread::hardware_concurrency() / 2;
+  int cpus = std::max(1u, std::thread::hardware_concurrency() / 2);
   std::cout << "Starting " << cpus << " threads" << std::endl;
   for (int i = 0; i != cpus; ++i)
   {
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "threads.h"
 
 #include <atomic>
@@ -14,13 +16,24 @@ class ThreadPoolWaiter
     jobs_ = jobs;
   }
 
-  void run_and_wait(ThreadPool& pool)
+  // Runs the jobs on the pool and waits for them, or runs them on this
+  // thread if there is no pool.
+  void run_and_wait(ThreadPool* pool)
   {
+    if (pool == nullptr)
+    {
+      for (auto& job : jobs_)
+      {
+        job();
+      }
+      return;
+    }
+
     std::latch latch(jobs_.size());
 
     for (auto& job : jobs_)
     {
-      pool.enqueue([&latch, job]() {
+      pool->enqueue([&latch, job]() {
         job();
         latch.count_down();
       });